@@ -0,0 +1,142 @@
+/*
+libactor - A C Actor Library
+bench_aio.c
+
+Random 4 KB reads from a cached file through actor_io_read(), keeping a
+growing number of reads in flight, with ordinary and with registered
+buffers. The engine is chosen on the command line, so that io_uring and
+the thread pool can be compared.
+
+usage: bench_aio uring|threads [reads]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+#include <unistd.h>
+
+#include "actor.h"
+
+#define BENCH_FILE_SIZE (64L << 20)
+#define BENCH_BLOCK 4096
+#define BENCH_MAX_DEPTH 128
+
+static const int depths[] = { 1, 16, BENCH_MAX_DEPTH };
+
+static const char *mode_name = "uring";
+static long reads = 200000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long long random_offset(unsigned long *seed) {
+  *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (long long)((*seed >> 33) % (BENCH_FILE_SIZE / BENCH_BLOCK))
+      * BENCH_BLOCK;
+}
+
+/* one buffer per read in flight; a read's tag is its buffer's index */
+static void run(int fd, char *bufs, int depth, const char *buffers) {
+  unsigned long seed = 1;
+  actor_io_result_t *res;
+  actor_msg_t *msg;
+  long started, done = 0;
+  double start;
+
+  start = now_ns();
+  for (started = 0; started < depth && started < reads; started++) {
+    actor_io_read(fd, bufs + started * BENCH_BLOCK, BENCH_BLOCK,
+                  random_offset(&seed), started);
+  }
+  while (done < reads) {
+    msg = actor_receive();
+    res = (actor_io_result_t *)msg->data;
+    if (res->result != BENCH_BLOCK) {
+      printf("read failed: %ld\n", res->result);
+      exit(1);
+    }
+    done++;
+    if (started < reads) {
+      actor_io_read(fd, res->buf, BENCH_BLOCK, random_offset(&seed), res->tag);
+      started++;
+    }
+    arelease(msg);
+  }
+  printf("mode=%s buffers=%s depth=%d reads_per_sec=%.0f\n",
+         mode_name, buffers, depth, reads / ((now_ns() - start) / 1e9));
+}
+
+void *bench_main(void *args) {
+  int ndepths = sizeof(depths) / sizeof(depths[0]);
+  size_t len = (size_t)BENCH_MAX_DEPTH * BENCH_BLOCK;
+  char path[] = "/tmp/bench_aio.XXXXXX";
+  char *bufs = malloc(len);
+  void *buf_list[1];
+  long written;
+  int fd, x;
+
+  if ((fd = mkstemp(path)) < 0) {
+    perror("mkstemp");
+    return 0;
+  }
+  unlink(path);
+
+  /* written through the page cache, so that reads measure the engine */
+  memset(bufs, 'x', len);
+  for (written = 0; written < BENCH_FILE_SIZE; written += len) {
+    if (write(fd, bufs, len) != (ssize_t)len) {
+      perror("write");
+      return 0;
+    }
+  }
+
+  for (x = 0; x < ndepths; x++) run(fd, bufs, depths[x], "plain");
+
+  buf_list[0] = bufs;
+  if (actor_io_register_buffers(buf_list, &len, 1) == 0) {
+    for (x = 0; x < ndepths; x++) run(fd, bufs, depths[x], "registered");
+    actor_io_register_buffers(NULL, NULL, 0);
+  }
+
+  close(fd);
+  free(bufs);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int engine = ACTOR_IO_ENGINE_URING;
+
+  actor_init();
+
+  if (argc > 1 && strcmp(argv[1], "threads") == 0) {
+    mode_name = "threads";
+    engine = ACTOR_IO_ENGINE_THREADS;
+  }
+  if (argc > 2) reads = atol(argv[2]);
+  if (actor_set_io_engine(engine) != 0) {
+    fprintf(stderr, "the %s engine is not available\n", mode_name);
+    return 1;
+  }
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,156 @@
+/*
+libactor - A C Actor Library
+bench_alloc.c
+
+Measures amalloc() + arelease() while a growing number of blocks are
+outstanding, and the cost of releasing them all again. Then counts the
+calls into the system allocator made by steady-state ping-pong messaging
+between two actors; malloc() and friends are wrapped in this file.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_PAIRS 100000
+#define BENCH_BLOCK_SIZE 64
+#define BENCH_WARMUP 1000
+#define BENCH_ROUND_TRIPS 100000
+
+#define BENCH_PING 100
+#define BENCH_STOP 101
+
+static const long outstanding_counts[] = { 0, 1000, 10000, 100000, 1000000 };
+static const size_t payload_sizes[] = { 0, 16, 256, 1024, 8192 };
+
+static long malloc_calls = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  __atomic_add_fetch(&malloc_calls, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  __atomic_add_fetch(&malloc_calls, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&malloc_calls, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *echo(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_PING) {
+      actor_reply_msg(msg, BENCH_PING, msg->data, msg->size);
+    }
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+void bench_messages() {
+  int nsizes = sizeof(payload_sizes) / sizeof(payload_sizes[0]);
+  char payload[8192];
+  actor_id echo_id = spawn_actor(echo, NULL);
+  long calls;
+  double start;
+  long x;
+  int y;
+
+  memset(payload, 'x', sizeof(payload));
+  for (y = 0; y < nsizes; y++) {
+    for (x = 0; x < BENCH_WARMUP; x++) {
+      actor_send_msg(echo_id, BENCH_PING, payload, payload_sizes[y]);
+      arelease(actor_receive());
+    }
+
+    calls = __atomic_load_n(&malloc_calls, __ATOMIC_RELAXED);
+    start = now_ns();
+    for (x = 0; x < BENCH_ROUND_TRIPS; x++) {
+      actor_send_msg(echo_id, BENCH_PING, payload, payload_sizes[y]);
+      arelease(actor_receive());
+    }
+    printf("payload=%zu ns_per_round_trip=%.0f mallocs_per_round_trip=%.3f\n",
+           payload_sizes[y],
+           (now_ns() - start) / BENCH_ROUND_TRIPS,
+           (double)(__atomic_load_n(&malloc_calls, __ATOMIC_RELAXED) - calls) /
+               BENCH_ROUND_TRIPS);
+  }
+  actor_send_msg(echo_id, BENCH_STOP, NULL, 0);
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(outstanding_counts) / sizeof(outstanding_counts[0]);
+  long max = outstanding_counts[nsizes - 1];
+  void **blocks = malloc(sizeof(void *) * max);
+  long held = 0;
+  double start;
+  long x;
+  int y;
+
+  for (y = 0; y < nsizes; y++) {
+    for (; held < outstanding_counts[y]; held++) {
+      blocks[held] = amalloc(BENCH_BLOCK_SIZE);
+    }
+
+    start = now_ns();
+    for (x = 0; x < BENCH_PAIRS; x++) {
+      arelease(amalloc(BENCH_BLOCK_SIZE));
+    }
+    printf("outstanding=%ld ns_per_alloc_release=%.1f\n",
+           held, (now_ns() - start) / BENCH_PAIRS);
+  }
+
+  start = now_ns();
+  for (x = 0; x < held; x++) {
+    arelease(blocks[x]);
+  }
+  printf("outstanding=%ld ns_per_release_all=%.1f\n",
+         held, (now_ns() - start) / held);
+
+  free(blocks);
+
+  bench_messages();
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+libactor - A C Actor Library
+bench_batch.c
+
+Bursty sends: one producer emits bursts of messages spread over a few
+consumers, either with one actor_send_msg() per message or with one
+actor_send_batch() per burst.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_BURST 256
+#define BENCH_BURSTS 2000
+#define BENCH_MAX_CONSUMERS 16
+
+#define BENCH_MSG 100
+#define BENCH_DONE 101
+
+static const int consumer_counts[] = { 1, 4, 16 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* receives `args` messages, then reports back */
+void *consumer(void *args) {
+  long expected = (long)args;
+  actor_msg_t *msg;
+  long x;
+
+  for (x = 0; x < expected; x++) {
+    msg = actor_receive();
+    if (x == expected - 1) actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+    arelease(msg);
+  }
+  return 0;
+}
+
+void run(int consumers, int batched) {
+  actor_send_entry_t burst[BENCH_BURST];
+  actor_id ids[BENCH_MAX_CONSUMERS];
+  long per_consumer = (long)BENCH_BURST * BENCH_BURSTS / consumers;
+  long payload = 0;
+  double start;
+  int x, y;
+
+  for (x = 0; x < consumers; x++) {
+    ids[x] = spawn_actor(consumer, (void *)per_consumer);
+  }
+
+  start = now_ns();
+  for (x = 0; x < BENCH_BURSTS; x++) {
+    for (y = 0; y < BENCH_BURST; y++) {
+      payload++;
+      if (batched) {
+        burst[y].dest = ids[y % consumers];
+        burst[y].type = BENCH_MSG;
+        burst[y].data = &payload;
+        burst[y].size = sizeof(payload);
+        continue;
+      }
+      actor_send_msg(ids[y % consumers], BENCH_MSG, &payload, sizeof(payload));
+    }
+    if (batched) actor_send_batch(burst, BENCH_BURST);
+  }
+  for (x = 0; x < consumers; x++) {
+    arelease(actor_receive());
+  }
+
+  printf("send=%s consumers=%d msgs_per_sec=%.0f\n",
+         batched ? "batch" : "single", consumers,
+         (double)BENCH_BURST * BENCH_BURSTS / ((now_ns() - start) / 1e9));
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(consumer_counts) / sizeof(consumer_counts[0]);
+  int x;
+
+  for (x = 0; x < nsizes; x++) {
+    run(consumer_counts[x], 0);
+    run(consumer_counts[x], 1);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
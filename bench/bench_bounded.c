@@ -0,0 +1,138 @@
+/*
+libactor - A C Actor Library
+bench_bounded.c
+
+A producer floods a consumer that does a little work per message. Reports,
+for an unbounded mailbox and for each backpressure policy, how many
+messages were received, the peak mailbox depth the producer saw and how
+many messages the mailbox dropped.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <sched.h>
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_MESSAGES 200000
+#define BENCH_CAPACITY 1024
+#define BENCH_WORK 200
+#define BENCH_MSG 100
+#define BENCH_STOP 101
+#define BENCH_DONE 102
+
+struct bench_config {
+  const char *name;
+  long capacity;
+  int policy;
+};
+
+static const struct bench_config configs[] = {
+  { "unbounded", 0, ACTOR_MAILBOX_BLOCK },
+  { "block", BENCH_CAPACITY, ACTOR_MAILBOX_BLOCK },
+  { "fail", BENCH_CAPACITY, ACTOR_MAILBOX_FAIL },
+  { "drop_oldest", BENCH_CAPACITY, ACTOR_MAILBOX_DROP_OLDEST },
+  { "drop_newest", BENCH_CAPACITY, ACTOR_MAILBOX_DROP_NEWEST }
+};
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *consumer(void *args) {
+  actor_msg_t *msg;
+  volatile long sink = 0;
+  long received = 0;
+  int x;
+
+  for (;;) {
+    msg = actor_receive();
+    if (msg->type == BENCH_STOP) break;
+    for (x = 0; x < BENCH_WORK; x++) sink += x;
+    received++;
+    arelease(msg);
+  }
+  actor_reply_msg(msg, BENCH_DONE, &received, sizeof(received));
+  arelease(msg);
+  return 0;
+}
+
+void *bench_main(void *args) {
+  int nconfigs = sizeof(configs) / sizeof(configs[0]);
+  actor_spawn_opts_t opts;
+  actor_mailbox_stats_t stats;
+  actor_msg_t *msg;
+  actor_id consumer_id;
+  long peak, rejected;
+  double start;
+  long x;
+  int c;
+
+  for (c = 0; c < nconfigs; c++) {
+    memset(&opts, 0, sizeof(opts));
+    opts.mailbox_capacity = configs[c].capacity;
+    opts.mailbox_policy = configs[c].policy;
+    consumer_id = spawn_actor_ex(consumer, NULL, &opts);
+
+    peak = 0;
+    rejected = 0;
+    start = now_ns();
+    for (x = 0; x < BENCH_MESSAGES; x++) {
+      if (configs[c].policy == ACTOR_MAILBOX_FAIL) {
+        if (actor_try_send(consumer_id, BENCH_MSG, &x, sizeof(x)) != 0) {
+          rejected++;
+        }
+      } else {
+        actor_send_msg(consumer_id, BENCH_MSG, &x, sizeof(x));
+      }
+      if ((x & 255) == 0) {
+        actor_mailbox_stats(consumer_id, &stats);
+        if (stats.depth > peak) peak = stats.depth;
+      }
+    }
+
+    /* the stop message must not be shed */
+    do {
+      sched_yield();
+      actor_mailbox_stats(consumer_id, &stats);
+    } while (stats.depth > 0);
+    actor_send_msg(consumer_id, BENCH_STOP, NULL, 0);
+    msg = actor_receive();
+
+    printf("mailbox=%s received=%ld peak_depth=%ld dropped=%ld "
+           "rejected=%ld msgs_per_sec=%.0f\n",
+           configs[c].name,
+           *(long *)msg->data,
+           peak,
+           stats.dropped,
+           rejected,
+           *(long *)msg->data / ((now_ns() - start) / 1e9));
+    arelease(msg);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
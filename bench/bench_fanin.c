@@ -0,0 +1,105 @@
+/*
+libactor - A C Actor Library
+bench_fanin.c
+
+N producers flood a single aggregator actor. Reports aggregate message
+throughput for increasing producer counts.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_TOTAL_MESSAGES 50000
+#define BENCH_MSG 100
+#define BENCH_DONE 101
+
+static const int producer_counts[] = { 1, 2, 4, 8, 16, 64, 256 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct producer_args {
+  actor_id aggregator;
+  long count;
+};
+
+void *producer(void *args) {
+  actor_msg_t *msg = actor_receive();
+  struct producer_args *pa = (struct producer_args *)msg->data;
+  long x;
+
+  for (x = 0; x < pa->count; x++) {
+    actor_send_msg(pa->aggregator, BENCH_MSG, NULL, 0);
+  }
+  arelease(msg);
+  return 0;
+}
+
+void *aggregator(void *args) {
+  actor_msg_t *msg = actor_receive();
+  int producers = *(int *)msg->data;
+  long total = BENCH_TOTAL_MESSAGES / producers * producers;
+  struct producer_args pa;
+  double start;
+  long x;
+
+  pa.aggregator = actor_self();
+  pa.count = total / producers;
+
+  start = now_ns();
+  for (x = 0; x < producers; x++) {
+    actor_send_msg(spawn_actor(producer, NULL), BENCH_MSG, &pa, sizeof(pa));
+  }
+  for (x = 0; x < total; x++) {
+    arelease(actor_receive());
+  }
+  printf("producers=%d msgs_per_sec=%.0f\n",
+         producers, total / ((now_ns() - start) / 1e9));
+
+  actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+  arelease(msg);
+  return 0;
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(producer_counts) / sizeof(producer_counts[0]);
+  int x;
+
+  for (x = 0; x < nsizes; x++) {
+    actor_send_msg(
+        spawn_actor(aggregator, NULL),
+        BENCH_MSG,
+        (void *)&producer_counts[x],
+        sizeof(int));
+    arelease(actor_receive());
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
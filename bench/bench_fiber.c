@@ -0,0 +1,121 @@
+/*
+libactor - A C Actor Library
+bench_fiber.c
+
+Compares the thread and fiber schedulers: spawn+exit rate for short-lived
+actors, and ping-pong round-trip latency between two actors.
+
+usage: bench_fiber threads|fibers [spawn_count] [round_trips]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+/* children alive at once while measuring spawn rate */
+#define BENCH_SPAWN_WINDOW 64
+
+#define BENCH_PING 100
+#define BENCH_PONG 101
+#define BENCH_STOP 102
+
+static const char *mode_name = "threads";
+static long spawn_count = 1000000;
+static long round_trips = 100000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *child(void *args) {
+  actor_send_msg((actor_id)args, BENCH_STOP, NULL, 0);
+  return 0;
+}
+
+void *pong(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_PING) actor_reply_msg(msg, BENCH_PONG, NULL, 0);
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+void *bench_main(void *args) {
+  actor_id self = actor_self();
+  actor_id pong_id;
+  long outstanding = 0;
+  long x;
+  double start;
+
+  start = now_ns();
+  for (x = 0; x < spawn_count; x++) {
+    if (outstanding == BENCH_SPAWN_WINDOW) {
+      arelease(actor_receive());
+      outstanding--;
+    }
+    if (spawn_actor(child, (void *)self) == ACTOR_INVALID) {
+      printf("spawn failed after %ld actors\n", x);
+      break;
+    }
+    outstanding++;
+  }
+  for (; outstanding > 0; outstanding--) {
+    arelease(actor_receive());
+  }
+  printf("mode=%s spawned=%ld spawns_per_sec=%.0f\n",
+         mode_name, x, x / ((now_ns() - start) / 1e9));
+
+  pong_id = spawn_actor(pong, NULL);
+  start = now_ns();
+  for (x = 0; x < round_trips; x++) {
+    actor_send_msg(pong_id, BENCH_PING, NULL, 0);
+    arelease(actor_receive());
+  }
+  printf("mode=%s round_trips=%ld ns_per_round_trip=%.0f\n",
+         mode_name, round_trips, (now_ns() - start) / round_trips);
+  actor_send_msg(pong_id, BENCH_STOP, NULL, 0);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+
+  if (argc > 1 && strcmp(argv[1], "fibers") == 0) {
+    mode_name = "fibers";
+    if (actor_set_scheduler(ACTOR_SCHED_FIBERS, 0) != 0) {
+      fprintf(stderr, "could not start the fiber scheduler\n");
+      return 1;
+    }
+  }
+  if (argc > 2) spawn_count = atol(argv[2]);
+  if (argc > 3) round_trips = atol(argv[3]);
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
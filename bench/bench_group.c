@@ -0,0 +1,137 @@
+/*
+libactor - A C Actor Library
+bench_group.c
+
+Fan-out to many subscribers: one actor_group_publish() per message versus
+one actor_send_msg() per subscriber, for small and large payloads.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_TOPIC 7
+/* deliveries per run, spread over however many subscribers there are */
+#define BENCH_DELIVERIES 200000
+#define BENCH_MAX_PAYLOAD 16384
+
+#define BENCH_JOIN 100
+#define BENCH_MSG 101
+#define BENCH_DONE 102
+#define BENCH_STOP 103
+
+static const int subscriber_counts[] = { 10, 100, 1000 };
+static const size_t payload_sizes[] = { 16, 16384 };
+
+/* messages each subscriber gets in the current run */
+static long publishes;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct subscriber {
+  actor_id report;
+  long received;
+};
+
+void subscriber_handler(void *state, actor_msg_t *msg) {
+  struct subscriber *sub = (struct subscriber *)state;
+
+  switch (msg->type) {
+    case BENCH_JOIN:
+      actor_group_join(BENCH_TOPIC);
+      actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+      break;
+    case BENCH_MSG:
+      if (++sub->received == publishes) {
+        sub->received = 0;
+        actor_send_msg(sub->report, BENCH_DONE, NULL, 0);
+      }
+      break;
+    case BENCH_STOP:
+      actor_exit();
+      break;
+  }
+}
+
+void run(actor_id *ids, int count, char *payload, size_t size, int grouped) {
+  double start = now_ns();
+  int x, y;
+
+  for (x = 0; x < publishes; x++) {
+    if (grouped) {
+      actor_group_publish(BENCH_TOPIC, BENCH_MSG, payload, size);
+      continue;
+    }
+    for (y = 0; y < count; y++) {
+      actor_send_msg(ids[y], BENCH_MSG, payload, size);
+    }
+  }
+  for (x = 0; x < count; x++) {
+    arelease(actor_receive());
+  }
+
+  printf("send=%s subscribers=%d payload=%zu deliveries_per_sec=%.0f\n",
+         grouped ? "publish" : "each", count, size,
+         (double)count * publishes / ((now_ns() - start) / 1e9));
+}
+
+void *bench_main(void *args) {
+  int ncounts = sizeof(subscriber_counts) / sizeof(subscriber_counts[0]);
+  int nsizes = sizeof(payload_sizes) / sizeof(payload_sizes[0]);
+  int max = subscriber_counts[ncounts - 1];
+  struct subscriber *subs = calloc(max, sizeof(struct subscriber));
+  actor_id *ids = malloc(sizeof(actor_id) * max);
+  char *payload = calloc(1, BENCH_MAX_PAYLOAD);
+  int joined = 0;
+  int x, y;
+
+  for (x = 0; x < ncounts; x++) {
+    for (; joined < subscriber_counts[x]; joined++) {
+      subs[joined].report = actor_self();
+      ids[joined] = spawn_actor_handler(subscriber_handler, &subs[joined]);
+      actor_send_msg(ids[joined], BENCH_JOIN, NULL, 0);
+      arelease(actor_receive());
+    }
+    publishes = BENCH_DELIVERIES / joined;
+    for (y = 0; y < nsizes; y++) {
+      run(ids, joined, payload, payload_sizes[y], 0);
+      run(ids, joined, payload, payload_sizes[y], 1);
+    }
+  }
+
+  for (x = 0; x < joined; x++) {
+    actor_send_msg(ids[x], BENCH_STOP, NULL, 0);
+  }
+  free(ids);
+  free(payload);
+  /* subs stay allocated: the handlers may still be draining */
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
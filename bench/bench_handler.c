@@ -0,0 +1,127 @@
+/*
+libactor - A C Actor Library
+bench_handler.c
+
+Run-to-completion handler actors: ping-pong round-trip latency between two
+handlers, and message throughput across a ring of handlers passing tokens.
+
+usage: bench_handler [ring_size] [hops]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+/* ring tokens carry the number of hops they have left as their type */
+#define BENCH_TOKEN 100
+#define BENCH_DONE -1
+#define BENCH_STOP -2
+
+/* tokens circulating the ring at once */
+#define BENCH_TOKENS 64
+
+static long ring_size = 1000;
+static long hops = 1000000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct ring_node {
+  actor_id next;
+  actor_id report;
+};
+
+void ring_handler(void *state, actor_msg_t *msg) {
+  struct ring_node *node = (struct ring_node *)state;
+
+  if (msg->type == BENCH_STOP) {
+    actor_exit();
+  } else if (msg->type == 1) {
+    actor_send_msg(node->report, BENCH_DONE, NULL, 0);
+  } else {
+    actor_send_msg(node->next, msg->type - 1, NULL, 0);
+  }
+}
+
+void pong_handler(void *state, actor_msg_t *msg) {
+  if (msg->type == BENCH_STOP) {
+    actor_exit();
+    return;
+  }
+  actor_reply_msg(msg, BENCH_TOKEN, NULL, 0);
+}
+
+void *bench_main(void *args) {
+  struct ring_node *nodes = calloc(ring_size, sizeof(struct ring_node));
+  actor_id *ids = malloc(sizeof(actor_id) * ring_size);
+  long per_token = hops / BENCH_TOKENS;
+  actor_id pong_id;
+  double start;
+  long x;
+
+  pong_id = spawn_actor_handler(pong_handler, NULL);
+  start = now_ns();
+  for (x = 0; x < 100000; x++) {
+    actor_send_msg(pong_id, BENCH_TOKEN, NULL, 0);
+    arelease(actor_receive());
+  }
+  printf("handlers round_trips=%ld ns_per_round_trip=%.0f\n",
+         x, (now_ns() - start) / x);
+  actor_send_msg(pong_id, BENCH_STOP, NULL, 0);
+
+  for (x = 0; x < ring_size; x++) {
+    nodes[x].report = actor_self();
+    ids[x] = spawn_actor_handler(ring_handler, &nodes[x]);
+  }
+  for (x = 0; x < ring_size; x++) {
+    nodes[x].next = ids[(x + 1) % ring_size];
+  }
+
+  start = now_ns();
+  for (x = 0; x < BENCH_TOKENS; x++) {
+    actor_send_msg(ids[x * ring_size / BENCH_TOKENS], per_token, NULL, 0);
+  }
+  for (x = 0; x < BENCH_TOKENS; x++) {
+    arelease(actor_receive());
+  }
+  printf("handlers ring=%ld hops=%ld msgs_per_sec=%.0f\n",
+         ring_size, per_token * BENCH_TOKENS,
+         per_token * BENCH_TOKENS / ((now_ns() - start) / 1e9));
+
+  for (x = 0; x < ring_size; x++) {
+    actor_send_msg(ids[x], BENCH_STOP, NULL, 0);
+  }
+  free(ids);
+  /* nodes stay allocated: the handlers may still be draining */
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  if (argc > 1) ring_size = atol(argv[1]);
+  if (argc > 2) hops = atol(argv[2]);
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
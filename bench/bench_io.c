@@ -0,0 +1,219 @@
+/*
+libactor - A C Actor Library
+bench_io.c
+
+Serves a minimal HTTP exchange over growing numbers of connections,
+once with a blocking actor per connection, as examples/http_server.c
+used to, and once with a single actor multiplexing every connection
+through actor_watch_fd(). Connections are socketpairs; the driver sends
+a request on each, then reads every response, for a few rounds.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "actor.h"
+
+#define BENCH_ROUNDS 20
+#define BENCH_READY 100
+#define BENCH_DONE 101
+
+/* blocking actors are OS threads, so they stop short of the reactor */
+#define BENCH_MAX_THREADS 1000
+
+static const int conn_counts[] = { 10, 100, 1000, 4000, 10000 };
+
+static const char request[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+static const char response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 13\r\n"
+    "\r\n"
+    "Hello, World!";
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* feeds `len` bytes to a header parser; 1 when `*state` saw "\r\n\r\n" */
+static int end_of_request(int *state, const char *data, size_t len) {
+  static const char end[] = "\r\n\r\n";
+  int done = 0;
+  size_t x;
+
+  for (x = 0; x < len; x++) {
+    if (data[x] == end[*state]) *state += 1;
+    else *state = data[x] == '\r' ? 1 : 0;
+    if (*state == 4) {
+      *state = 0;
+      done = 1;
+    }
+  }
+  return done;
+}
+
+static void send_response(int fd) {
+  if (write(fd, response, sizeof(response) - 1) < 0) perror("write");
+}
+
+void *blocking_client(void *args) {
+  int fd = (int)(long)args;
+  char buf[512];
+  int state = 0;
+  ssize_t n;
+
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    if (end_of_request(&state, buf, n)) send_response(fd);
+  }
+  close(fd);
+  return 0;
+}
+
+/* serves every connection it is sent, then reports when all are closed */
+void *reactor_server(void *args) {
+  actor_msg_t *msg = actor_receive();
+  int *fds = (int *)msg->data;
+  int count = msg->size / sizeof(int);
+  int open = count;
+  int *state;
+  int max_fd = 0;
+  actor_io_event_t *ev;
+  actor_msg_t *io;
+  int x;
+
+  for (x = 0; x < count; x++) {
+    if (fds[x] > max_fd) max_fd = fds[x];
+    actor_watch_fd(fds[x], ACTOR_IO_DATA);
+  }
+  /* one header parser per descriptor */
+  state = calloc(max_fd + 1, sizeof(int));
+  actor_reply_msg(msg, BENCH_READY, NULL, 0);
+
+  while (open > 0) {
+    io = actor_receive();
+    ev = (actor_io_event_t *)io->data;
+    if (io->type == ACTOR_MSG_IO_DATA) {
+      if (end_of_request(&state[ev->fd], ev->data, ev->len)) {
+        send_response(ev->fd);
+      }
+    } else if (io->type == ACTOR_MSG_IO_CLOSED) {
+      close(ev->fd);
+      open--;
+    }
+    arelease(io);
+  }
+
+  actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+  arelease(msg);
+  free(state);
+  return 0;
+}
+
+static void run(const char *mode, int count) {
+  int *client = malloc(sizeof(int) * count);
+  int *server = malloc(sizeof(int) * count);
+  char buf[sizeof(response)];
+  actor_id reactor = ACTOR_INVALID;
+  int sp[2];
+  double start;
+  int x, round;
+  size_t got;
+  ssize_t n;
+
+  for (x = 0; x < count; x++) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) != 0) {
+      perror("socketpair");
+      exit(1);
+    }
+    client[x] = sp[0];
+    server[x] = sp[1];
+  }
+
+  if (strcmp(mode, "reactor") == 0) {
+    reactor = spawn_actor(reactor_server, NULL);
+    actor_send_msg(reactor, BENCH_READY, server, sizeof(int) * count);
+    arelease(actor_receive());
+  } else {
+    for (x = 0; x < count; x++) {
+      spawn_actor(blocking_client, (void *)(long)server[x]);
+    }
+  }
+
+  start = now_ns();
+  for (round = 0; round < BENCH_ROUNDS; round++) {
+    for (x = 0; x < count; x++) {
+      if (write(client[x], request, sizeof(request) - 1) < 0) perror("write");
+    }
+    for (x = 0; x < count; x++) {
+      for (got = 0; got < sizeof(response) - 1; got += n) {
+        n = read(client[x], buf, sizeof(response) - 1 - got);
+        if (n <= 0) {
+          perror("read");
+          exit(1);
+        }
+      }
+    }
+  }
+  printf("mode=%s connections=%d requests_per_sec=%.0f\n",
+         mode, count, count * BENCH_ROUNDS / ((now_ns() - start) / 1e9));
+
+  for (x = 0; x < count; x++) close(client[x]);
+  if (reactor != ACTOR_INVALID) arelease(actor_receive());
+
+  free(client);
+  free(server);
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(conn_counts) / sizeof(conn_counts[0]);
+  struct rlimit rl;
+  int x;
+
+  /* two descriptors per connection */
+  getrlimit(RLIMIT_NOFILE, &rl);
+  rl.rlim_cur = rl.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &rl);
+
+  for (x = 0; x < nsizes; x++) {
+    if ((rlim_t)conn_counts[x] * 2 + 64 > rl.rlim_cur) {
+      printf("connections=%d skipped, descriptor limit is %ld\n",
+             conn_counts[x], (long)rl.rlim_cur);
+      break;
+    }
+    if (conn_counts[x] <= BENCH_MAX_THREADS) run("blocking", conn_counts[x]);
+    run("reactor", conn_counts[x]);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+libactor - A C Actor Library
+bench_large.c
+
+Large-message throughput between two actors: actor_send_msg() copying a
+buffer versus actor_send_owned() handing over an amalloc()ed block.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+/* messages in flight at once */
+#define BENCH_WINDOW 16
+#define BENCH_BYTES (1L << 30)
+
+#define BENCH_DATA 100
+#define BENCH_ACK 101
+#define BENCH_STOP 102
+
+static const size_t msg_sizes[] = { 4096, 65536, 1 << 20, 4 << 20 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *sink(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_DATA) {
+      actor_reply_msg(msg, BENCH_ACK, NULL, 0);
+    }
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+void send_one(actor_id dest, char *buffer, size_t size, int owned) {
+  void *block;
+
+  if (owned) {
+    block = amalloc(size);
+    ((char *)block)[0] = buffer[0];
+    actor_send_owned(dest, BENCH_DATA, block, size);
+  } else {
+    actor_send_msg(dest, BENCH_DATA, buffer, size);
+  }
+}
+
+void run(actor_id dest, char *buffer, size_t size, int owned) {
+  long count = BENCH_BYTES / size;
+  double start = now_ns();
+  double secs;
+  long x;
+
+  for (x = 0; x < count; x++) {
+    if (x >= BENCH_WINDOW) arelease(actor_receive());
+    send_one(dest, buffer, size, owned);
+  }
+  for (x = 0; x < BENCH_WINDOW && x < count; x++) {
+    arelease(actor_receive());
+  }
+
+  secs = (now_ns() - start) / 1e9;
+  printf("send=%s size=%zu msgs_per_sec=%.0f mb_per_sec=%.0f\n",
+         owned ? "owned" : "copy", size, count / secs,
+         count * (double)size / secs / (1 << 20));
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(msg_sizes) / sizeof(msg_sizes[0]);
+  char *buffer = malloc(msg_sizes[nsizes - 1]);
+  actor_id sink_id = spawn_actor(sink, NULL);
+  int x;
+
+  memset(buffer, 'x', msg_sizes[nsizes - 1]);
+  for (x = 0; x < nsizes; x++) {
+    run(sink_id, buffer, msg_sizes[x], 0);
+    run(sink_id, buffer, msg_sizes[x], 1);
+  }
+  actor_send_msg(sink_id, BENCH_STOP, NULL, 0);
+  free(buffer);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+libactor - A C Actor Library
+bench_match.c
+
+Request/response round trips while unrelated messages are queued in the
+requester's mailbox: actor_receive_match() against the hand-written loop
+that pops messages and re-sends the unwanted ones to itself.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_ROUND_TRIPS 2000
+
+#define BENCH_NOISE 100
+#define BENCH_REQUEST 101
+#define BENCH_REPLY 102
+#define BENCH_STOP 103
+
+static const int backlog_counts[] = { 0, 100, 1000, 10000 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *server(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_REQUEST) {
+      actor_reply_msg(msg, BENCH_REPLY, NULL, 0);
+    }
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+/* the pre-selective-receive idiom: requeue everything that is not a reply */
+actor_msg_t *receive_reply_by_hand() {
+  actor_msg_t *msg;
+
+  for (;;) {
+    msg = actor_receive();
+    if (msg->type == BENCH_REPLY) return msg;
+    actor_send_msg(actor_self(), msg->type, msg->data, msg->size);
+    arelease(msg);
+  }
+}
+
+void run(actor_id server_id, int backlog, int matched) {
+  actor_id self = actor_self();
+  actor_msg_t *msg;
+  double start;
+  int x;
+
+  for (x = 0; x < backlog; x++) {
+    actor_send_msg(self, BENCH_NOISE, NULL, 0);
+  }
+
+  start = now_ns();
+  for (x = 0; x < BENCH_ROUND_TRIPS; x++) {
+    actor_send_msg(server_id, BENCH_REQUEST, NULL, 0);
+    if (matched) msg = actor_receive_match(BENCH_REPLY, 0);
+    else msg = receive_reply_by_hand();
+    arelease(msg);
+  }
+  printf("receive=%s backlog=%d ns_per_round_trip=%.0f\n",
+         matched ? "match" : "requeue", backlog,
+         (now_ns() - start) / BENCH_ROUND_TRIPS);
+
+  for (x = 0; x < backlog; x++) {
+    arelease(actor_receive());
+  }
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(backlog_counts) / sizeof(backlog_counts[0]);
+  actor_id server_id = spawn_actor(server, NULL);
+  int x;
+
+  for (x = 0; x < nsizes; x++) {
+    run(server_id, backlog_counts[x], 0);
+    run(server_id, backlog_counts[x], 1);
+  }
+  actor_send_msg(server_id, BENCH_STOP, NULL, 0);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,150 @@
+/*
+libactor - A C Actor Library
+bench_numa.c
+
+Ping-pong round-trip latency between two thread-mode actors pinned to the
+same NUMA node and to different nodes, with small messages and with
+payloads big enough to live outside the envelope. The "near" run places
+the pong actor with ACTOR_PLACE_NEAR next to an unpinned ping actor. On a
+machine with a single node the cross-node run is skipped.
+
+usage: bench_numa [round_trips]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_MAX_PAYLOAD 4096
+
+#define BENCH_START 100
+#define BENCH_PING 101
+#define BENCH_PONG 102
+#define BENCH_STOP 103
+#define BENCH_DONE 104
+
+static const size_t payload_sizes[] = { 16, 4096 };
+
+static long round_trips = 100000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct run {
+  const char *name;
+  actor_spawn_opts_t ping;
+  actor_spawn_opts_t pong;
+};
+
+void *pong(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_PING) {
+      actor_reply_msg(msg, BENCH_PONG, msg->data, msg->size);
+    }
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+void *ping(void *args) {
+  actor_msg_t *start_msg = actor_receive();
+  struct run *run = *(struct run **)start_msg->data;
+  char *payload = calloc(1, BENCH_MAX_PAYLOAD);
+  int nsizes = sizeof(payload_sizes) / sizeof(payload_sizes[0]);
+  actor_id pong_id;
+  double start;
+  long x;
+  int y;
+
+  if (run->pong.placement == ACTOR_PLACE_NEAR) run->pong.near = actor_self();
+  pong_id = spawn_actor_ex(pong, NULL, &run->pong);
+
+  for (y = 0; y < nsizes; y++) {
+    start = now_ns();
+    for (x = 0; x < round_trips; x++) {
+      actor_send_msg(pong_id, BENCH_PING, payload, payload_sizes[y]);
+      arelease(actor_receive());
+    }
+    printf("placement=%s payload=%zu ns_per_round_trip=%.0f\n",
+           run->name, payload_sizes[y], (now_ns() - start) / round_trips);
+  }
+
+  actor_send_msg(pong_id, BENCH_STOP, NULL, 0);
+  actor_reply_msg(start_msg, BENCH_DONE, NULL, 0);
+  arelease(start_msg);
+  free(payload);
+  return 0;
+}
+
+void *bench_main(void *args) {
+  struct run runs[3];
+  struct run *run;
+  int nruns = 0;
+  int x;
+
+  memset(runs, 0, sizeof(runs));
+
+  runs[nruns].name = "same_node";
+  runs[nruns].ping.placement = ACTOR_PLACE_NODE;
+  runs[nruns].pong.placement = ACTOR_PLACE_NODE;
+  nruns++;
+
+  runs[nruns].name = "near";
+  runs[nruns].pong.placement = ACTOR_PLACE_NEAR;
+  nruns++;
+
+  if (actor_numa_nodes() > 1) {
+    runs[nruns].name = "cross_node";
+    runs[nruns].ping.placement = ACTOR_PLACE_NODE;
+    runs[nruns].pong.placement = ACTOR_PLACE_NODE;
+    runs[nruns].pong.node = 1;
+    nruns++;
+  } else {
+    printf("one NUMA node, skipping placement=cross_node\n");
+  }
+
+  for (x = 0; x < nruns; x++) {
+    run = &runs[x];
+    actor_send_msg(
+        spawn_actor_ex(ping, NULL, &run->ping),
+        BENCH_START,
+        &run,
+        sizeof(run));
+    arelease(actor_receive());
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  if (argc > 1) round_trips = atol(argv[1]);
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+libactor - A C Actor Library
+bench_pool.c
+
+Sends jobs of uneven cost to a pool of workers under each routing strategy
+and reports job throughput and the mean and 99th percentile time from send
+to completion. One job in BENCH_HEAVY_EVERY costs BENCH_HEAVY_SPIN times as
+much as the others, so strategies that look at mailbox depth can steer
+around the workers stuck on one.
+
+usage: bench_pool threads|fibers [workers] [jobs]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+/* jobs in flight at once */
+#define BENCH_WINDOW 256
+#define BENCH_HEAVY_EVERY 16
+#define BENCH_HEAVY_SPIN 50
+#define BENCH_SPIN 2000
+
+#define BENCH_JOB 100
+#define BENCH_DONE 101
+
+static const char *strategy_names[] = {
+  "round_robin", "least_loaded", "consistent_hash", "power_of_two"
+};
+
+static const char *mode_name = "threads";
+static int workers = 8;
+static long jobs = 100000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct job {
+  double sent;
+  long spin;
+};
+
+void *worker(void *args) {
+  actor_msg_t *msg;
+  struct job *job;
+  double latency;
+  volatile long sink = 0;
+  long x;
+
+  for (;;) {
+    msg = actor_receive();
+    if (msg->type != BENCH_JOB) {  /* ACTOR_MSG_POOL_LEAVE */
+      arelease(msg);
+      break;
+    }
+    job = (struct job *)msg->data;
+    for (x = 0; x < job->spin; x++) sink += x;
+    latency = now_ns() - job->sent;
+    actor_reply_msg(msg, BENCH_DONE, &latency, sizeof(latency));
+    arelease(msg);
+  }
+  return 0;
+}
+
+int compare_double(const void *a, const void *b) {
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+void run(int strategy, double *latencies) {
+  actor_id pool = spawn_actor_pool(worker, NULL, workers, strategy);
+  actor_msg_t *msg;
+  struct job job;
+  double start, elapsed, total = 0;
+  long sent = 0;
+  long x;
+
+  start = now_ns();
+  for (x = 0; x < jobs; x++) {
+    while (sent - x < BENCH_WINDOW && sent < jobs) {
+      job.spin = BENCH_SPIN;
+      if (sent % BENCH_HEAVY_EVERY == 0) job.spin *= BENCH_HEAVY_SPIN;
+      job.sent = now_ns();
+      actor_send_keyed(pool, sent, BENCH_JOB, &job, sizeof(job));
+      sent++;
+    }
+    msg = actor_receive();
+    latencies[x] = *(double *)msg->data;
+    total += latencies[x];
+    arelease(msg);
+  }
+  elapsed = now_ns() - start;
+  actor_pool_resize(pool, 0);
+
+  qsort(latencies, jobs, sizeof(double), compare_double);
+  printf("mode=%s strategy=%s workers=%d jobs_per_sec=%.0f "
+         "mean_us=%.1f p99_us=%.1f\n",
+         mode_name, strategy_names[strategy], workers,
+         jobs / (elapsed / 1e9), total / jobs / 1e3,
+         latencies[jobs * 99 / 100] / 1e3);
+}
+
+void *bench_main(void *args) {
+  double *latencies = malloc(sizeof(double) * jobs);
+  int x;
+
+  for (x = ACTOR_POOL_ROUND_ROBIN; x <= ACTOR_POOL_POWER_OF_TWO; x++) {
+    run(x, latencies);
+  }
+  free(latencies);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+
+  if (argc > 1 && strcmp(argv[1], "fibers") == 0) {
+    mode_name = "fibers";
+    if (actor_set_scheduler(ACTOR_SCHED_FIBERS, 0) != 0) {
+      fprintf(stderr, "could not start the fiber scheduler\n");
+      return 1;
+    }
+  }
+  if (argc > 2) workers = atoi(argv[2]);
+  if (argc > 3) jobs = atol(argv[3]);
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+libactor - A C Actor Library
+bench_prio.c
+
+Measures how long a control message takes to reach an actor whose mailbox
+already holds a backlog of normal messages, when the control message is
+sent at normal priority versus ACTOR_PRIO_HIGH.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_MSG 100
+#define BENCH_CONTROL 101
+#define BENCH_DONE 102
+
+static const long backlogs[] = { 0, 10000, 100000 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct prio_args {
+  long backlog;
+  int prio;
+};
+
+/* fills its own mailbox, queues the control message behind the backlog,
+   then times how long it takes to get to it */
+void *worker(void *args) {
+  actor_msg_t *start_msg = actor_receive();
+  struct prio_args *pa = (struct prio_args *)start_msg->data;
+  actor_id self = actor_self();
+  actor_msg_t *msg;
+  double start;
+  long x;
+
+  for (x = 0; x < pa->backlog; x++) {
+    actor_send_msg(self, BENCH_MSG, NULL, 0);
+  }
+
+  start = now_ns();
+  actor_send_msg_prio(self, BENCH_CONTROL, NULL, 0, pa->prio);
+  for (x = 0; ; x++) {
+    msg = actor_receive();
+    if (msg->type == BENCH_CONTROL) break;
+    arelease(msg);
+  }
+  printf("backlog=%ld prio=%s control_latency_us=%.1f skipped=%ld\n",
+         pa->backlog,
+         pa->prio == ACTOR_PRIO_HIGH ? "high" : "normal",
+         (now_ns() - start) / 1e3,
+         x);
+  arelease(msg);
+
+  /* drain what the high priority run jumped over */
+  for (; x < pa->backlog; x++) {
+    arelease(actor_receive());
+  }
+
+  actor_reply_msg(start_msg, BENCH_DONE, NULL, 0);
+  arelease(start_msg);
+  return 0;
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(backlogs) / sizeof(backlogs[0]);
+  struct prio_args pa;
+  int x;
+
+  for (x = 0; x < nsizes; x++) {
+    pa.backlog = backlogs[x];
+    for (pa.prio = ACTOR_PRIO_NORMAL; pa.prio <= ACTOR_PRIO_HIGH; pa.prio++) {
+      actor_send_msg(spawn_actor(worker, NULL), BENCH_MSG, &pa, sizeof(pa));
+      arelease(actor_receive());
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
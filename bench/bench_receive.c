@@ -0,0 +1,116 @@
+/*
+libactor - A C Actor Library
+bench_receive.c
+
+Measures the cost of actor_receive() + arelease() while a growing number of
+idle actors exist. The receiving actor fills its own mailbox first, so only
+the receive path is timed. The same is then done with actor_receive_many()
+and arelease_many().
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_MESSAGES 10000
+#define BENCH_RECEIVE_MANY 64
+#define BENCH_MSG 100
+#define BENCH_STOP 101
+
+static const int idle_counts[] = { 0, 10, 100, 1000, 2000 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *idle_actor(void *args) {
+  arelease(actor_receive());
+  return 0;
+}
+
+/* spawned after the idle actors, so it sits at the far end of the registry */
+void *receiver(void *args) {
+  actor_msg_t *start_msg = actor_receive();
+  actor_msg_t *msgs[BENCH_RECEIVE_MANY];
+  actor_id self = actor_self();
+  double start;
+  int x, n;
+
+  for (x = 0; x < BENCH_MESSAGES; x++) {
+    actor_send_msg(self, BENCH_MSG, NULL, 0);
+  }
+
+  start = now_ns();
+  for (x = 0; x < BENCH_MESSAGES; x++) {
+    arelease(actor_receive());
+  }
+  printf("idle_actors=%d ns_per_receive=%.1f\n",
+         *(int *)start_msg->data, (now_ns() - start) / BENCH_MESSAGES);
+
+  for (x = 0; x < BENCH_MESSAGES; x++) {
+    actor_send_msg(self, BENCH_MSG, NULL, 0);
+  }
+
+  start = now_ns();
+  for (x = 0; x < BENCH_MESSAGES; x += n) {
+    n = actor_receive_many(msgs, BENCH_RECEIVE_MANY, 0);
+    arelease_many((void **)msgs, n);
+  }
+  printf("idle_actors=%d ns_per_receive_many=%.1f\n",
+         *(int *)start_msg->data, (now_ns() - start) / BENCH_MESSAGES);
+
+  actor_reply_msg(start_msg, BENCH_STOP, NULL, 0);
+  arelease(start_msg);
+  return 0;
+}
+
+void *bench_main(void *args) {
+  int nsizes = sizeof(idle_counts) / sizeof(idle_counts[0]);
+  actor_id *idle = malloc(sizeof(actor_id) * idle_counts[nsizes - 1]);
+  int spawned = 0;
+  int x;
+
+  for (x = 0; x < nsizes; x++) {
+    for (; spawned < idle_counts[x]; spawned++) {
+      idle[spawned] = spawn_actor(idle_actor, NULL);
+    }
+    actor_send_msg(
+        spawn_actor(receiver, NULL),
+        BENCH_MSG,
+        (void *)&idle_counts[x],
+        sizeof(int));
+    arelease(actor_receive());
+  }
+
+  for (x = 0; x < spawned; x++) {
+    actor_send_msg(idle[x], BENCH_STOP, NULL, 0);
+  }
+  free(idle);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
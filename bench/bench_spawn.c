@@ -0,0 +1,109 @@
+/*
+libactor - A C Actor Library
+bench_spawn.c
+
+Measures how long spawn_actor_ex() takes to return and the spawn+exit rate
+of short-lived actors, with default thread stacks and with small stacks
+without a guard page. In thread mode the first window of spawns creates
+threads; later ones reuse the threads parked by actors that exited.
+
+usage: bench_spawn threads|fibers [spawn_count]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+/* children alive at once */
+#define BENCH_SPAWN_WINDOW 64
+#define BENCH_SMALL_STACK (64 * 1024)
+
+#define BENCH_DONE 100
+
+static const char *mode_name = "threads";
+static long spawn_count = 100000;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *child(void *args) {
+  actor_send_msg((actor_id)args, BENCH_DONE, NULL, 0);
+  return 0;
+}
+
+void run(const char *name, const actor_spawn_opts_t *opts) {
+  actor_id self = actor_self();
+  long outstanding = 0;
+  double start, spawning = 0, t;
+  long x;
+
+  start = now_ns();
+  for (x = 0; x < spawn_count; x++) {
+    if (outstanding == BENCH_SPAWN_WINDOW) {
+      arelease(actor_receive());
+      outstanding--;
+    }
+    t = now_ns();
+    if (spawn_actor_ex(child, (void *)self, opts) == ACTOR_INVALID) {
+      printf("spawn failed after %ld actors\n", x);
+      break;
+    }
+    spawning += now_ns() - t;
+    outstanding++;
+  }
+  for (; outstanding > 0; outstanding--) {
+    arelease(actor_receive());
+  }
+  printf("mode=%s stacks=%s spawned=%ld ns_per_spawn=%.0f "
+         "spawns_per_sec=%.0f\n",
+         mode_name, name, x, spawning / x,
+         x / ((now_ns() - start) / 1e9));
+}
+
+void *bench_main(void *args) {
+  actor_spawn_opts_t small = { 0 };
+
+  small.stack_size = BENCH_SMALL_STACK;
+  small.guard_pages = ACTOR_NO_GUARD;
+
+  run("default", NULL);
+  run("small", &small);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+
+  if (argc > 1 && strcmp(argv[1], "fibers") == 0) {
+    mode_name = "fibers";
+    if (actor_set_scheduler(ACTOR_SCHED_FIBERS, 0) != 0) {
+      fprintf(stderr, "could not start the fiber scheduler\n");
+      return 1;
+    }
+  }
+  if (argc > 2) spawn_count = atol(argv[2]);
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+libactor - A C Actor Library
+bench_timer.c
+
+Arms and cancels growing numbers of pending actor_send_after() timers and
+reports the cost of each operation, then measures how late delayed
+messages and receive timeouts arrive.
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_LATE_MESSAGES 200
+#define BENCH_MSG 100
+
+static const long pending_counts[] = { 1000, 10000, 100000, 500000 };
+static const long receive_timeouts[] = { 10, 250, 1500 };
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *bench_main(void *args) {
+  int npending = sizeof(pending_counts) / sizeof(pending_counts[0]);
+  int ntimeouts = sizeof(receive_timeouts) / sizeof(receive_timeouts[0]);
+  actor_id self = actor_self();
+  actor_timer_t *timers;
+  actor_msg_t *msg;
+  double start, arm_ns, late_ms;
+  long x, n, delay;
+  int c;
+
+  timers = malloc(sizeof(actor_timer_t) * pending_counts[npending - 1]);
+
+  for (c = 0; c < npending; c++) {
+    n = pending_counts[c];
+
+    /* spread over an hour so the timers land on every level */
+    start = now_ns();
+    for (x = 0; x < n; x++) {
+      delay = 1000 + (x * 7919) % 3600000;
+      timers[x] = actor_send_after(self, delay, BENCH_MSG, NULL, 0);
+    }
+    arm_ns = (now_ns() - start) / n;
+
+    start = now_ns();
+    for (x = 0; x < n; x++) actor_cancel_timer(timers[x]);
+    printf("pending=%ld ns_per_arm=%.0f ns_per_cancel=%.0f\n",
+           n, arm_ns, (now_ns() - start) / n);
+  }
+  free(timers);
+
+  late_ms = 0;
+  start = now_ns();
+  for (x = 0; x < BENCH_LATE_MESSAGES; x++) {
+    delay = 1 + x % 100;
+    actor_send_after(self, delay, BENCH_MSG, &delay, sizeof(delay));
+  }
+  for (x = 0; x < BENCH_LATE_MESSAGES; x++) {
+    msg = actor_receive();
+    late_ms += (now_ns() - start) / 1e6 - *(long *)msg->data;
+    arelease(msg);
+  }
+  printf("send_after messages=%d avg_late_ms=%.2f\n",
+         BENCH_LATE_MESSAGES, late_ms / BENCH_LATE_MESSAGES);
+
+  for (c = 0; c < ntimeouts; c++) {
+    start = now_ns();
+    actor_receive_timeout(receive_timeouts[c]);
+    printf("receive_timeout=%ld waited_ms=%.1f\n",
+           receive_timeouts[c], (now_ns() - start) / 1e6);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  actor_init();
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -0,0 +1,538 @@
+/*
+libactor - A C Actor Library
+libactor_bench.c
+
+The benchmark suite: short runs of ping-pong latency, fan-in, broadcast
+fan-out, spawn/exit rate, amalloc()/arelease(), mailbox depth scaling,
+actor_stats_snapshot() and the cost of tracing, reported as JSON or CSV so that results can
+be kept and compared across releases, schedulers, allocators and builds
+with and without the runtime counters. The bench_*
+programs next to it measure single features in more detail.
+
+usage: libactor_bench [--sched threads|fibers] [--format json|csv]
+                      [--only name] [--scale factor] [--output file]
+
+Copyright (C) 2009 Chris Moos
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+
+#include "actor.h"
+
+#define BENCH_MAX_RESULTS 64
+
+/* children alive at once while measuring spawn rate */
+#define BENCH_SPAWN_WINDOW 64
+
+#define BENCH_MSG 100
+#define BENCH_DONE 101
+#define BENCH_STOP 102
+
+#if defined(ACTOR_NO_SLAB)
+#  define BENCH_ALLOCATOR "malloc"
+#else
+#  define BENCH_ALLOCATOR "slab"
+#endif  // defined(ACTOR_NO_SLAB)
+
+#if defined(ACTOR_NO_STATS)
+#  define BENCH_STATS "off"
+#else
+#  define BENCH_STATS "on"
+#endif  // defined(ACTOR_NO_STATS)
+
+struct bench_result {
+  const char *bench;
+  const char *param;  /* what `n` counts */
+  long n;
+  const char *metric;
+  double value;
+};
+
+struct bench_case {
+  const char *name;
+  void (*run)();
+};
+
+static const char *sched_name = "threads";
+static const char *only = NULL;
+static double scale = 1.0;
+static FILE *out;
+static int csv = 0;
+
+static struct bench_result results[BENCH_MAX_RESULTS];
+static int nresults = 0;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long scaled(long count) {
+  long n = (long)(count * scale);
+  return n > 0 ? n : 1;
+}
+
+static void report(
+    const char *bench,
+    const char *param,
+    long n,
+    const char *metric,
+    double value) {
+
+  struct bench_result *r;
+
+  if (nresults == BENCH_MAX_RESULTS) return;
+  r = &results[nresults++];
+  r->bench = bench;
+  r->param = param;
+  r->n = n;
+  r->metric = metric;
+  r->value = value;
+}
+
+
+/*------------------------------------------------------------------------------
+                                   ping-pong
+------------------------------------------------------------------------------*/
+
+void *pong(void *args) {
+  actor_msg_t *msg;
+  int done = 0;
+
+  while (!done) {
+    msg = actor_receive();
+    if (msg->type == BENCH_MSG) actor_reply_msg(msg, BENCH_MSG, NULL, 0);
+    done = msg->type == BENCH_STOP;
+    arelease(msg);
+  }
+  return 0;
+}
+
+static void bench_pingpong() {
+  actor_id pong_id = spawn_actor(pong, NULL);
+  long round_trips = scaled(100000);
+  double start;
+  long x;
+
+  start = now_ns();
+  for (x = 0; x < round_trips; x++) {
+    actor_send_msg(pong_id, BENCH_MSG, NULL, 0);
+    arelease(actor_receive());
+  }
+  report("pingpong", "round_trips", round_trips, "ns_per_round_trip",
+         (now_ns() - start) / round_trips);
+  actor_send_msg(pong_id, BENCH_STOP, NULL, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+                                     fan-in
+------------------------------------------------------------------------------*/
+
+struct producer_args {
+  actor_id aggregator;
+  long count;
+};
+
+void *producer(void *args) {
+  actor_msg_t *msg = actor_receive();
+  struct producer_args *pa = (struct producer_args *)msg->data;
+  long x;
+
+  for (x = 0; x < pa->count; x++) {
+    actor_send_msg(pa->aggregator, BENCH_MSG, NULL, 0);
+  }
+  arelease(msg);
+  return 0;
+}
+
+static void bench_fanin() {
+  static const int producer_counts[] = { 1, 4, 16, 64 };
+  int ncounts = sizeof(producer_counts) / sizeof(producer_counts[0]);
+  struct producer_args pa;
+  long total;
+  double start;
+  int producers;
+  int x;
+  long y;
+
+  pa.aggregator = actor_self();
+  for (x = 0; x < ncounts; x++) {
+    producers = producer_counts[x];
+    pa.count = scaled(200000) / producers;
+    total = pa.count * producers;
+
+    start = now_ns();
+    for (y = 0; y < producers; y++) {
+      actor_send_msg(spawn_actor(producer, NULL), BENCH_MSG, &pa, sizeof(pa));
+    }
+    for (y = 0; y < total; y++) {
+      arelease(actor_receive());
+    }
+    report("fanin", "producers", producers, "msgs_per_sec",
+           total / ((now_ns() - start) / 1e9));
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                    fan-out
+------------------------------------------------------------------------------*/
+
+struct receiver {
+  actor_id report;
+  long expected;
+  long received;
+};
+
+void receiver_handler(void *state, actor_msg_t *msg) {
+  struct receiver *r = (struct receiver *)state;
+
+  if (msg->type == BENCH_STOP) {
+    /* the last look at `state`, which the reply lets the owner free */
+    actor_exit();
+    actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+  } else if (msg->type == BENCH_MSG && ++r->received == r->expected) {
+    actor_send_msg(r->report, BENCH_DONE, NULL, 0);
+  }
+}
+
+static void bench_fanout() {
+  static const int receiver_counts[] = { 10, 100, 1000 };
+  int ncounts = sizeof(receiver_counts) / sizeof(receiver_counts[0]);
+  struct receiver *recv;
+  actor_id *ids;
+  actor_msg_t *msg;
+  long broadcasts, x;
+  int count, done, y, z;
+  double start;
+
+  for (y = 0; y < ncounts; y++) {
+    count = receiver_counts[y];
+    broadcasts = scaled(200000) / count;
+    recv = calloc(count, sizeof(struct receiver));
+    ids = malloc(sizeof(actor_id) * count);
+    for (z = 0; z < count; z++) {
+      recv[z].report = actor_self();
+      recv[z].expected = broadcasts;
+      ids[z] = spawn_actor_handler(receiver_handler, &recv[z]);
+    }
+
+    /* the broadcaster gets its own copies too */
+    start = now_ns();
+    for (x = 0; x < broadcasts; x++) {
+      actor_broadcast_msg(BENCH_MSG, NULL, 0);
+    }
+    for (done = 0; done < count;) {
+      msg = actor_receive();
+      if (msg->type == BENCH_DONE) done++;
+      arelease(msg);
+    }
+    report("fanout", "receivers", count, "deliveries_per_sec",
+           (double)count * broadcasts / ((now_ns() - start) / 1e9));
+
+    for (z = 0; z < count; z++) actor_send_msg(ids[z], BENCH_STOP, NULL, 0);
+    for (z = 0; z < count; z++) arelease(actor_receive_match(BENCH_DONE, 0));
+    free(ids);
+    free(recv);
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                  spawn/exit
+------------------------------------------------------------------------------*/
+
+void *child(void *args) {
+  actor_send_msg((actor_id)args, BENCH_DONE, NULL, 0);
+  return 0;
+}
+
+static void bench_spawn() {
+  actor_id self = actor_self();
+  long spawns = scaled(20000);
+  long outstanding = 0;
+  double start;
+  long x;
+
+  start = now_ns();
+  for (x = 0; x < spawns; x++) {
+    if (outstanding == BENCH_SPAWN_WINDOW) {
+      arelease(actor_receive());
+      outstanding--;
+    }
+    spawn_actor(child, (void *)self);
+    outstanding++;
+  }
+  for (; outstanding > 0; outstanding--) {
+    arelease(actor_receive());
+  }
+  report("spawn", "actors", spawns, "spawns_per_sec",
+         spawns / ((now_ns() - start) / 1e9));
+}
+
+
+/*------------------------------------------------------------------------------
+                                   allocation
+------------------------------------------------------------------------------*/
+
+static void bench_alloc() {
+  static const long sizes[] = { 16, 256, 4096, 65536 };
+  int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  long pairs = scaled(1000000);
+  double start;
+  long x;
+  int y;
+
+  for (y = 0; y < nsizes; y++) {
+    start = now_ns();
+    for (x = 0; x < pairs; x++) {
+      arelease(amalloc(sizes[y]));
+    }
+    report("alloc", "bytes", sizes[y], "ns_per_amalloc_arelease",
+           (now_ns() - start) / pairs);
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                 mailbox depth
+------------------------------------------------------------------------------*/
+
+static void bench_depth() {
+  static const long depths[] = { 10, 1000, 100000 };
+  int ndepths = sizeof(depths) / sizeof(depths[0]);
+  actor_id self = actor_self();
+  double send_ns, receive_ns, start;
+  long rounds, r, x;
+  int y;
+
+  for (y = 0; y < ndepths; y++) {
+    rounds = scaled(200000) / depths[y];
+    if (rounds < 1) rounds = 1;
+    send_ns = receive_ns = 0;
+
+    for (r = 0; r < rounds; r++) {
+      start = now_ns();
+      for (x = 0; x < depths[y]; x++) {
+        actor_send_msg(self, BENCH_MSG, NULL, 0);
+      }
+      send_ns += now_ns() - start;
+
+      start = now_ns();
+      for (x = 0; x < depths[y]; x++) {
+        arelease(actor_receive());
+      }
+      receive_ns += now_ns() - start;
+    }
+    report("depth", "messages", depths[y], "ns_per_send",
+           send_ns / (rounds * depths[y]));
+    report("depth", "messages", depths[y], "ns_per_receive",
+           receive_ns / (rounds * depths[y]));
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                    snapshot
+------------------------------------------------------------------------------*/
+
+void idle_handler(void *state, actor_msg_t *msg) {
+  if (msg->type == BENCH_STOP) {
+    actor_exit();
+    actor_reply_msg(msg, BENCH_DONE, NULL, 0);
+  }
+}
+
+static void bench_snapshot() {
+  static const int actor_counts[] = { 100, 1000, 10000 };
+  int ncounts = sizeof(actor_counts) / sizeof(actor_counts[0]);
+  actor_stats_t *stats;
+  actor_id *ids;
+  long rounds, r;
+  int count, found, y, z;
+  double start;
+
+  for (y = 0; y < ncounts; y++) {
+    count = actor_counts[y];
+    rounds = scaled(2000000) / count;
+    stats = malloc(sizeof(actor_stats_t) * (count + 1));
+    ids = malloc(sizeof(actor_id) * count);
+    for (z = 0; z < count; z++) {
+      ids[z] = spawn_actor_handler(idle_handler, NULL);
+    }
+
+    found = 0;
+    start = now_ns();
+    for (r = 0; r < rounds; r++) {
+      found = actor_stats_snapshot(stats, count + 1);
+    }
+    report("snapshot", "actors", found, "ns_per_actor",
+           (now_ns() - start) / ((double)rounds * found));
+
+    for (z = 0; z < count; z++) actor_send_msg(ids[z], BENCH_STOP, NULL, 0);
+    for (z = 0; z < count; z++) arelease(actor_receive_match(BENCH_DONE, 0));
+    free(ids);
+    free(stats);
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                    tracing
+------------------------------------------------------------------------------*/
+
+static void bench_trace() {
+  actor_id pong_id = spawn_actor(pong, NULL);
+  long round_trips = scaled(100000);
+  const char *path = "libactor_bench-trace.json";
+  double start;
+  long x;
+  int on;
+
+  for (on = 0; on <= 1; on++) {
+    if (on) actor_trace_start();
+    start = now_ns();
+    for (x = 0; x < round_trips; x++) {
+      actor_send_msg(pong_id, BENCH_MSG, NULL, 0);
+      arelease(actor_receive());
+    }
+    report("trace", "round_trips", round_trips,
+           on ? "ns_per_round_trip_traced" : "ns_per_round_trip",
+           (now_ns() - start) / round_trips);
+  }
+  actor_trace_stop();
+
+  start = now_ns();
+  if (actor_trace_dump(path) == 0) {
+    report("trace", "round_trips", round_trips, "ms_per_dump",
+           (now_ns() - start) / 1e6);
+    remove(path);
+  }
+  actor_send_msg(pong_id, BENCH_STOP, NULL, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+                                     driver
+------------------------------------------------------------------------------*/
+
+static const struct bench_case cases[] = {
+  { "pingpong", bench_pingpong },
+  { "fanin", bench_fanin },
+  { "fanout", bench_fanout },
+  { "spawn", bench_spawn },
+  { "alloc", bench_alloc },
+  { "depth", bench_depth },
+  { "snapshot", bench_snapshot },
+  { "trace", bench_trace },
+};
+
+static void print_results() {
+  int x;
+
+  if (csv) {
+    fprintf(out, "sched,allocator,stats,bench,param,n,metric,value\n");
+    for (x = 0; x < nresults; x++) {
+      fprintf(out, "%s,%s,%s,%s,%s,%ld,%s,%.1f\n",
+              sched_name, BENCH_ALLOCATOR, BENCH_STATS, results[x].bench,
+              results[x].param, results[x].n, results[x].metric,
+              results[x].value);
+    }
+    return;
+  }
+
+  fprintf(out, "{\n  \"sched\": \"%s\",\n  \"allocator\": \"%s\",\n",
+          sched_name, BENCH_ALLOCATOR);
+  fprintf(out, "  \"stats\": \"%s\",\n", BENCH_STATS);
+  fprintf(out, "  \"results\": [\n");
+  for (x = 0; x < nresults; x++) {
+    fprintf(out,
+            "    {\"bench\": \"%s\", \"param\": \"%s\", \"n\": %ld, "
+            "\"metric\": \"%s\", \"value\": %.1f}%s\n",
+            results[x].bench, results[x].param, results[x].n,
+            results[x].metric, results[x].value,
+            x + 1 < nresults ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+void *bench_main(void *args) {
+  int ncases = sizeof(cases) / sizeof(cases[0]);
+  int x;
+
+  for (x = 0; x < ncases; x++) {
+    if (only != NULL && strcmp(only, cases[x].name) != 0) continue;
+    cases[x].run();
+  }
+  print_results();
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--sched threads|fibers] [--format json|csv]\n"
+          "          [--only name] [--scale factor] [--output file]\n",
+          prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *output = NULL;
+  int x;
+
+  for (x = 1; x < argc; x++) {
+    if (x + 1 == argc) usage(argv[0]);
+    if (strcmp(argv[x], "--sched") == 0) {
+      sched_name = argv[++x];
+    } else if (strcmp(argv[x], "--format") == 0) {
+      csv = strcmp(argv[++x], "csv") == 0;
+    } else if (strcmp(argv[x], "--only") == 0) {
+      only = argv[++x];
+    } else if (strcmp(argv[x], "--scale") == 0) {
+      scale = atof(argv[++x]);
+    } else if (strcmp(argv[x], "--output") == 0) {
+      output = argv[++x];
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  out = stdout;
+  if (output != NULL && (out = fopen(output, "w")) == NULL) {
+    perror(output);
+    return 1;
+  }
+
+  actor_init();
+  if (strcmp(sched_name, "fibers") == 0) {
+    if (actor_set_scheduler(ACTOR_SCHED_FIBERS, 0) != 0) {
+      fprintf(stderr, "could not start the fiber scheduler\n");
+      return 1;
+    }
+  } else {
+    sched_name = "threads";
+  }
+
+  spawn_actor(bench_main, NULL);
+  actor_wait_finish();
+  actor_destroy_all();
+
+  if (out != stdout) fclose(out);
+  return 0;
+}
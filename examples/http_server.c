@@ -4,6 +4,10 @@ http_server.c
 
 A Simple HTTP Server. Just returns "Hello, World to the client". Doesn't do any handling of headers.
 
+A single actor serves every connection: the listening socket and the
+clients are watched with actor_watch_fd(), so requests arrive as messages
+instead of tying up a thread per connection.
+
 Copyright (C) 2009 Chris Moos
 
 This program is free software; you can redistribute it and/or
@@ -24,133 +28,133 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <libactor/actor.h>
 
-#	include <sys/types.h>
-#	include <sys/socket.h>
-#	include <netinet/in.h>
-#	include <unistd.h>
-#	include <arpa/inet.h>
-
-
-#define BUFFER_SIZE 512
-#define HTTP_CLIENT_INFO 100
-
-
-unsigned char *recvline(int sockfd) {
-	unsigned char * buf = (unsigned char *) malloc(BUFFER_SIZE);
-	unsigned int len = 0, bufLen = BUFFER_SIZE;
-	int ret;
-	
-	for(;;) {
-		ret = recv(sockfd, buf + len, 1, 0);
-		if(ret <= 0) {
-			free(buf);
-			return NULL;
-		} else {
-			if(buf[len] == 0) {
-				free(buf);
-				return NULL;
-			}	
-			len += ret;
-			if(len >= 2 && (buf[len-2] == '\r' && buf[len-1] == '\n')) {
-				buf[len-2] = 0;
-				return buf;
-			}
-			if(len == (BUFFER_SIZE-1)) {
-				buf = (unsigned char*)realloc(buf, bufLen + BUFFER_SIZE);
-				bufLen += BUFFER_SIZE;
-			}
-		}
-	}
-	
-	return buf;
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <errno.h>
+
+
+/* bytes of "\r\n\r\n" seen so far, per client descriptor */
+#define MAX_CLIENTS 65536
+static unsigned char header_end[MAX_CLIENTS];
+
+
+/* feeds received data to the client's parser; 1 at the end of the headers */
+int request_complete(int sock, const char *data, size_t len) {
+  static const char end[] = "\r\n\r\n";
+  size_t x;
+
+  for (x = 0; x < len; x++) {
+    if (data[x] == end[header_end[sock]]) header_end[sock]++;
+    else header_end[sock] = data[x] == '\r' ? 1 : 0;
+    if (header_end[sock] == 4) return 1;
+  }
+  return 0;
+}
+
+
+void http_close(int sock) {
+  actor_unwatch_fd(sock);
+  close(sock);
+}
+
+
+void http_accept(int sockfd) {
+  struct sockaddr_in remote;
+  socklen_t socklen = sizeof(struct sockaddr_in);
+  int clientsock;
+
+  /* the listening socket is edge-triggered, so take every pending client */
+  while ((clientsock = accept(sockfd, (struct sockaddr *) &remote, &socklen)) != -1) {
+    if (clientsock >= MAX_CLIENTS || actor_watch_fd(clientsock, ACTOR_IO_DATA) != 0) {
+      close(clientsock);
+      continue;
+    }
+    header_end[clientsock] = 0;
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
 }
 
 
-ACTOR_FUNCTION(http_client, args) {
-	actor_msg_t * msg;
-	struct sockaddr_in * remote;
-	int sock = (int) args;
-	unsigned char * line = NULL;
-	char * response =
+void *http_listener(void *arg) {
+  struct sockaddr_in local;
+  actor_io_event_t *ev;
+  actor_msg_t *msg;
+  int sockfd;
+  char *response =
       "HTTP/1.1 200 OK\r\n"
       "Content-Type: text/plain\r\n"
-      "Content-Length: 12\r\n"
+      "Content-Length: 15\r\n"
       "\r\n"
       "Hello, World!\r\n";
 
-	msg = actor_receive();
-	if(msg->type == HTTP_CLIENT_INFO) {
-		remote = (struct sockaddr_in *) msg->data;
-		while((line = recvline(sock)) != NULL) {
-			if(*line == 0) {
-				free(line);
-				break;
-			}
-			free(line);
-		}
-		send(sock, response, strlen(response), 0);
-	}
-	arelease(msg);
-	close(sock);
-	return 0;
-}
+  int port = (int) (long) arg;
 
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = INADDR_ANY;
+  local.sin_port = htons(port);
+  sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 
-ACTOR_FUNCTION(http_listener, arg) {
-	struct sockaddr_in local, remote;
-	int sockfd;
-	int socklen = sizeof(struct sockaddr_in);
-	
-	int port = (int) arg;
-	
-	local.sin_family = AF_INET;
-	local.sin_addr.s_addr = INADDR_ANY;
-	local.sin_port = htons(port);
-	sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	
-	/* Set SO_REUSEADDR */
-	int sockoption = 1;
-	setsockopt(
+  /* Set SO_REUSEADDR */
+  int sockoption = 1;
+  setsockopt(
       sockfd,
       SOL_SOCKET,
       SO_REUSEADDR,
       (char*) &sockoption,
       sizeof(sockoption));
-	
+
   int bind_result =
       bind(sockfd, (struct sockaddr *) &local, sizeof(struct sockaddr_in));
 
-	if(bind_result == -1) {
+  if(bind_result == -1) {
     perror("bind");
     return 0;
   }
 
-  listen(sockfd, 0);
-	printf("HTTP server listening on port: %d\n", port);
-	
-	while(1) {
-    int clientsock = accept(sockfd, (struct sockaddr *) &remote, &socklen);
-		if(clientsock == -1) break;
-
-    actor_id aid = spawn_actor(http_client, (void *) clientsock);
-    actor_send_msg(
-        aid,
-        HTTP_CLIENT_INFO,
-        (void *) &remote,
-        sizeof(struct sockaddr_in));
-	}
-
-	return 0;
+  listen(sockfd, SOMAXCONN);
+  if (actor_watch_fd(sockfd, ACTOR_IO_READ) != 0) {
+    perror("actor_watch_fd");
+    return 0;
+  }
+  printf("HTTP server listening on port: %d\n", port);
+
+  while(1) {
+    msg = actor_receive();
+    ev = (actor_io_event_t *) msg->data;
+
+    switch (msg->type) {
+      case ACTOR_MSG_IO_READY:
+        if (ev->fd == sockfd) http_accept(sockfd);
+        break;
+      case ACTOR_MSG_IO_DATA:
+        if (request_complete(ev->fd, ev->data, ev->len)) {
+          send(ev->fd, response, strlen(response), 0);
+          http_close(ev->fd);
+        }
+        break;
+      case ACTOR_MSG_IO_CLOSED:
+        close(ev->fd);
+        break;
+    }
+    arelease(msg);
+  }
+
+  return 0;
 }
 
 
-ACTOR_FUNCTION(main_func, args) {
-	struct actor_main *amain = (struct actor_main *) args;
-	
-	if(amain->argc < 2) printf("usage: %s port\n", amain->argv[0]);
-	else                spawn_actor(http_listener, (void *) atoi(amain->argv[1]));
-	
-	return 0;
-}
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s port\n", argv[0]);
+    return 1;
+  }
 
-DECLARE_ACTOR_MAIN(main_func)
+  actor_init();
+  spawn_actor(http_listener, (void *) (long) atoi(argv[1]));
+  actor_wait_finish();
+  actor_destroy_all();
+  return 0;
+}
@@ -18,29 +18,100 @@
 */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sched.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 
 #if defined(WIN32)
 #  define PTHREAD_HANDLE(_t) _t.p
 #else
 #  include <sys/resource.h>
+#  include <unistd.h>
 #  define PTHREAD_HANDLE(_t) _t
 #endif  // defined(WIN32)
 
 #include "./actor.h"
+#include "./aio.h"
+#include "./epoch.h"
 #include "./list.h"
+#include "./reactor.h"
+#include "./scheduler.h"
+#include "./slab.h"
+#include "./slotmap.h"
+#include "./threads.h"
+#include "./topology.h"
+#include "./trace.h"
+#include "./wheel.h"
 
 static pthread_mutex_t actors_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t actors_cond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t actors_alloc = PTHREAD_MUTEX_INITIALIZER;
-static actors_ready = 0;
-static list_item_t *actor_list_real;
-static list_item_t **actor_list = &actor_list_real;
+static int actors_ready = 0;
+static int actors_sched_mode = ACTOR_SCHED_THREADS;
+static slotmap_t actor_registry;
 
-static list_item_t *alloc_list_real;
-static list_item_t **alloc_list = &alloc_list_real;
+/* publish/subscribe groups, hashed by topic */
+#define ACTOR_GROUP_BUCKETS 256
+static pthread_mutex_t groups_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct actor_group *actor_groups[ACTOR_GROUP_BUCKETS];
+
+/* points each member of an ACTOR_POOL_CONSISTENT_HASH pool has on the ring */
+#define ACTOR_POOL_POINTS 64
+
+/* per-thread state of the generator behind ACTOR_POOL_POWER_OF_TWO */
+static ACTOR_TLS unsigned long pool_random = 0;
+
+/* senders waiting for room in an ACTOR_MAILBOX_BLOCK mailbox sleep here */
+static pthread_mutex_t mailbox_space_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mailbox_space_cond = PTHREAD_COND_INITIALIZER;
+
+/* the thread-mode actor running on this thread, NULL otherwise */
+static ACTOR_TLS actor_state_t *current_actor = NULL;
+
+/* initial size of a stash's type table */
+#define ACTOR_STASH_TYPES 16
+
+/* batches with up to this many messages need no heap memory to group */
+#define ACTOR_BATCH_STACK 64
+
+/* how a send may react to a full mailbox, see _actor_mailbox_admit() */
+#define ACTOR_SEND_WAIT 0    /* wait for room if the policy says so */
+#define ACTOR_SEND_TRY 1     /* report a full mailbox instead of waiting */
+#define ACTOR_SEND_NOWAIT 2  /* drop instead of waiting (fan-out) */
+
+/* outcomes of _actor_mailbox_admit() */
+#define ACTOR_ADMIT_OK 0
+#define ACTOR_ADMIT_DROPPED 1
+#define ACTOR_ADMIT_FULL 2
+
+/* the block is an actor_msg_t holding the reference to its data */
+#define ACTOR_BLOCK_MSG 1
+
+#define ACTOR_BLOCK_HEADER(_block) ((actor_block_t*)(_block) - 1)
+#define ACTOR_BLOCK_DATA(_header) ((void*)((actor_block_t*)(_header) + 1))
+
+/* the counters behind actor_stats() are only written by the actor they
+   belong to, so a relaxed load and store do without a locked add */
+#if defined(ACTOR_NO_STATS)
+#  define ACTOR_STAT_ADD(_st, _field, _n) do {} while (0)
+#  define ACTOR_STAT_SET(_st, _field, _v) do {} while (0)
+#  define ACTOR_STAT_CLOCK() 0
+#else
+#  define ACTOR_STAT_ADD(_st, _field, _n) \
+     __atomic_store_n(&(_st)->_field, \
+         __atomic_load_n(&(_st)->_field, __ATOMIC_RELAXED) + (_n), \
+         __ATOMIC_RELAXED)
+#  define ACTOR_STAT_SET(_st, _field, _v) \
+     __atomic_store_n(&(_st)->_field, (_v), __ATOMIC_RELAXED)
+#  define ACTOR_STAT_CLOCK() _actor_now_ns()
+#endif  // defined(ACTOR_NO_STATS)
+
+typedef char actor_block_aligned[(sizeof(actor_block_t) % 16 == 0) ? 1 : -1];
+typedef char actor_msg_inline_aligned[
+    (offsetof(actor_msg_t, inline_data) % 16 == 0) ? 1 : -1];
 
 /* Private structs */
 struct actor_spawn_info {
@@ -49,6 +120,13 @@ struct actor_spawn_info {
   void *args;
 };
 
+/* when a receive gives up, in wheel_now() time */
+struct actor_deadline {
+  long timeout;
+  unsigned long expires;
+  long timer;  /* wakes the receiver at `expires`, armed on first wait */
+};
+
 
 /* Only use these functions if you know what you are doing
    (pthreads + concurrent memory access = death)
@@ -58,15 +136,85 @@ actor_msg_t *_actor_create_msg(
     void *data,
     size_t size,
     actor_id sender,
-    actor_id dest,
-    pthread_t thread);
-void *_amalloc_thread(size_t size, pthread_t thread);
-void _arelease(void *block, pthread_t thread);
-void _actor_send_msg(actor_id aid, long type, void *data, size_t size);
+    actor_id dest);
+void *_amalloc_actor(size_t size, actor_state_t *owner);
+void _actor_block_adopt(actor_state_t *owner, actor_block_t *b);
+long long _actor_now_ns();
+void _actor_block_disown(actor_block_t *b);
+void _actor_block_free(actor_block_t *b);
+void _arelease(void *block);
+actor_msg_t *_actor_create_msg_owned(
+    long type,
+    void *block,
+    size_t size,
+    actor_id sender,
+    actor_id dest);
+int _actor_send_msg(
+    actor_id aid,
+    unsigned long key,
+    long type,
+    void *data,
+    size_t size,
+    int prio,
+    int mode);
+actor_state_t *_actor_lookup(actor_id aid, unsigned long key);
+actor_state_t *_actor_pool_route(struct actor_pool *p, unsigned long key);
+void _actor_pool_set(struct actor_pool *p, actor_id *ids, int count);
+int _actor_pool_grow(struct actor_pool *p, actor_id pool, int count);
+int _actor_pool_shrink(struct actor_pool *p, actor_id pool, int count);
+void _actor_pool_release(struct actor_pool *p, actor_id pool);
+void _actor_pool_retire(actor_state_t *st);
+void _actor_pool_leave(actor_state_t *member);
+void _actor_pool_free(struct actor_pool *p);
+actor_msg_t *_actor_receive_wait(actor_state_t *st, long timeout);
+actor_msg_t *_actor_receive_match(
+    actor_state_t *st,
+    long type,
+    actor_match_func_ptr_t match,
+    void *arg,
+    long timeout);
+actor_msg_t *_actor_pop(actor_state_t *st);
+actor_msg_t *_actor_mailbox_pop(actor_state_t *st);
+actor_msg_t *_actor_lane_pop(actor_state_t *st, int lane);
+int _actor_mailbox_admit(actor_state_t *self, actor_state_t *st, int mode);
+int _actor_mailbox_shed(actor_state_t *st);
+void _actor_mailbox_wait(actor_state_t *self, actor_id aid);
+void _actor_deadline_init(struct actor_deadline *d, long timeout);
+void _actor_deadline_done(struct actor_deadline *d);
+void _actor_timeout_fire(void *arg, int fired);
+void _actor_timer_fire(void *arg, int fired);
+int _actor_io_send(actor_id owner, long type, void *data, size_t size);
+void _actor_io_done(struct aio_request *req);
+int _actor_io_ready(void *arg, int fd, int events);
+int _actor_io_data(void *arg, int fd, int events);
+int _actor_wait(actor_state_t *st, struct actor_deadline *d);
+void _actor_notify(actor_state_t *st, long type);
+void _actor_stash_put(actor_state_t *st, actor_msg_t *msg);
+actor_msg_t *_actor_stash_take_type(actor_state_t *st, long type);
+actor_msg_t *_actor_stash_take_first(actor_state_t *st);
+actor_msg_t *_actor_stash_take_match(
+    actor_state_t *st,
+    actor_match_func_ptr_t match,
+    void *arg);
+void _actor_stash_destroy(actor_state_t *st);
+void *_actor_fanout_begin(void *data, size_t size);
+void _actor_group_destroy_all();
+int _actor_fanout_send(
+    actor_state_t *st,
+    actor_id sender,
+    long type,
+    void *data,
+    void *shared,
+    size_t size);
+void _actor_send_owned(actor_id aid, long type, void *block, size_t size);
 void _actor_release_memory(actor_state_t *state);
 void _actor_destroy_state(actor_state_t *state);
+void _actor_free_state(void *state);
 void _actor_init_state(actor_state_t **state);
 actor_id _actor_find_by_thread();
+actor_state_t *_actor_current();
+void _actor_wake(actor_state_t *st);
+void _actor_send_exited(actor_state_t *state);
 
 /* Private */
 void actor_init_state(actor_state_t **state);
@@ -79,14 +227,23 @@ void actor_release_memory(actor_state_t *state);
 ------------------------------------------------------------------------------*/
 
 void actor_init() {
-  assert(actor_list != NULL);
-  if (actor_list == NULL) {
-    pthread_mutex_lock(&actors_mutex);
-    list_init(actor_list);
-    list_init(alloc_list);
+  pthread_mutex_lock(&actors_mutex);
+  if (actors_ready == 0) {
+    slotmap_init(&actor_registry);
     actors_ready = 1;
-    pthread_mutex_unlock(&actors_mutex);
   }
+  pthread_mutex_unlock(&actors_mutex);
+}
+
+int actor_set_scheduler(int mode, int workers) {
+  int ret = 0;
+
+  pthread_mutex_lock(&actors_mutex);
+  if (mode == ACTOR_SCHED_FIBERS) ret = sched_start(workers);
+  if (ret == 0) actors_sched_mode = mode;
+  pthread_mutex_unlock(&actors_mutex);
+
+  return ret;
 }
 
 void actor_wait_finish() {
@@ -96,7 +253,7 @@ void actor_wait_finish() {
 
   while (cont == 1) {
     pthread_mutex_lock(&actors_mutex);
-    if (list_count(actor_list) == 0) {
+    if (slotmap_count(&actor_registry) == 0) {
       goto end;
     } else {
       gettimeofday(&tp, NULL);
@@ -115,28 +272,33 @@ void actor_wait_finish() {
 
 void actor_destroy_all() {
   void *temp;
-  alloc_info_t *info;
+  long cursor = 0;
+
+  /* timers and I/O wake and send to actors, so they go first; pending
+     delayed messages are released and I/O in flight is cancelled */
+  aio_stop();
+  reactor_stop();
+  wheel_stop();
+  trace_stop();
+  threads_stop();
+
+  /* no fiber may run while its state is torn down */
+  sched_stop();
 
   pthread_mutex_lock(&actors_mutex);
 
-  /* Clean up actor list */
-  while ((temp = list_pop(actor_list)) != NULL) {
-    free(temp);
+  /* Clean up actor registry */
+  while ((temp = slotmap_next(&actor_registry, &cursor)) != NULL) {
+    sched_free(temp);
+    _actor_free_state(temp);
   }
+  slotmap_destroy(&actor_registry);
+  epoch_drain();
+  _actor_group_destroy_all();
 
   pthread_mutex_unlock(&actors_mutex);
   pthread_mutex_destroy(&actors_mutex);
-  pthread_mutex_destroy(&actors_alloc);
   pthread_cond_destroy(&actors_cond);
-
-  /* Clean up memory */
-  for (info = list_pop(alloc_list); info != NULL; info = list_pop(alloc_list)) {
-#ifdef DEBUG_MEMORY
-    printf("Unfreed block found.\n");
-#endif
-    free(info->block);
-    free(info);
-  }
 }
 
 
@@ -144,110 +306,299 @@ void actor_destroy_all() {
                                    spawn_actor
 ------------------------------------------------------------------------------*/
 
+/* tells a parent that traps exits that `state` is going away */
+void _actor_send_exited(actor_state_t *state) {
+  actor_state_t *parent;
+  actor_msg_t *msg;
+
+  if (state->parent == ACTOR_INVALID) return;
+
+  epoch_enter();
+  parent = slotmap_get(&actor_registry, state->parent);
+  if (parent != NULL && __atomic_load_n(&parent->trap_exit, __ATOMIC_ACQUIRE)) {
+    msg = _actor_create_msg(
+        ACTOR_MSG_EXITED, NULL, 0, state->myid, parent->myid);
+    /* control messages are not held to the mailbox capacity */
+    __atomic_fetch_add(&parent->mailbox_depth, 1, __ATOMIC_RELAXED);
+    queue_push(&parent->messages[ACTOR_PRIO_HIGH], msg);
+    _actor_notify(parent, ACTOR_MSG_EXITED);
+  }
+  epoch_exit();
+}
+
+void _actor_exit(actor_state_t *state) {
+  int may_have_waiters = state->mailbox_capacity > 0 &&
+      state->mailbox_policy == ACTOR_MAILBOX_BLOCK;
+
+  TRACE(TRACE_EXIT, state->myid, ACTOR_INVALID, 0, 0, 0, 0);
+
+  ACCESS_ACTORS_BEGIN;
+
+  if (state->pool_id != ACTOR_INVALID) _actor_pool_leave(state);
+  _actor_send_exited(state);
+  _actor_release_memory(state);
+  _actor_destroy_state(state);
+
+  /* senders waiting for room must notice that the actor is gone */
+  if (may_have_waiters) {
+    pthread_mutex_lock(&mailbox_space_mutex);
+    pthread_cond_broadcast(&mailbox_space_cond);
+    pthread_mutex_unlock(&mailbox_space_mutex);
+  }
+
+  pthread_cond_signal(&actors_cond);
+  ACCESS_ACTORS_END;
+}
+
+/* runs the actor's function, then tears the actor down */
+void _actor_run(struct actor_spawn_info *si) {
+  (si->fun)(si->args);
+
+  _actor_exit(si->state);
+  free(si);
+}
+
+/*
+  Pins the calling thread and points its allocations at the node's
+  memory; -1 for both undoes it.
+*/
+void _actor_place(int cpu, int node) {
+  topology_place(cpu, node);
+  slab_set_node(node);
+}
+
+/* satisfies threads_func_ptr_t; the thread is parked once it returns */
 void *spawn_actor_fun(void *arg) {
   struct actor_spawn_info *si = (struct actor_spawn_info*)arg;
+  int cpu = si->state->cpu;
+  int node = si->state->node;
 
   ACCESS_ACTORS_BEGIN;
   si->state->thread = pthread_self();
   ACCESS_ACTORS_END;
 
-  (si->fun)(si->args);
+  /* before the actor runs, so that its first allocations are local */
+  if (node >= 0) _actor_place(cpu, node);
 
-  ACCESS_ACTORS_BEGIN;
+  current_actor = si->state;
+  _actor_run(si);
+  current_actor = NULL;
 
-  _actor_release_memory(si->state);
-  _actor_destroy_state(si->state);
-  free(si);
+  /* the next actor on this thread may be placed elsewhere, or not at all */
+  if (node >= 0) _actor_place(-1, -1);
 
-  pthread_cond_signal(&actors_cond);
-  ACCESS_ACTORS_END;
+  return NULL;
+}
 
-  pthread_detach(pthread_self());
+/*
+  Works out the CPU and node opts ask for, -1 meaning any. Called with
+  actors_mutex held, which keeps `opts->near` from going away.
+*/
+int _actor_placement(const actor_spawn_opts_t *opts, int *cpu, int *node) {
+  actor_state_t *near;
+
+  *cpu = -1;
+  *node = -1;
+  switch (opts->placement) {
+    case ACTOR_PLACE_CPU:
+      *cpu = opts->cpu;
+      *node = topology_cpu_node(opts->cpu);
+      if (*node < 0 || !topology_cpu_usable(opts->cpu)) return -1;
+      break;
+    case ACTOR_PLACE_NODE:
+      if (!topology_node_usable(opts->node)) return -1;
+      *node = opts->node;
+      break;
+    case ACTOR_PLACE_NEAR:
+      near = slotmap_get(&actor_registry, opts->near);
+      *node = (near != NULL && near->node >= 0) ?
+          near->node : topology_current_node();
+      /* the caller's node may have none of the process's CPUs left */
+      if (!topology_node_usable(*node)) *node = -1;
+      break;
+  }
+  return 0;
+}
 
-  pthread_exit((void*)NULL);
+/* satisfies sched_entry_func_ptr_t */
+void spawn_actor_fiber(void *arg) {
+  _actor_run((struct actor_spawn_info*)arg);
 }
 
 actor_id spawn_actor(actor_function_ptr_t func, void *args) {
+  return spawn_actor_ex(func, args, NULL);
+}
+
+actor_id spawn_actor_ex(
+    actor_function_ptr_t func,
+    void *args,
+    const actor_spawn_opts_t *opts) {
+
   actor_state_t *state;
   actor_id aid;
+  int ret;
   struct actor_spawn_info *si;
+  size_t stack_size = 0;
+  long guard_size = -1;
+  int cpu = -1;
+  int node = -1;
 
   assert(func != NULL);
 
   ACCESS_ACTORS_BEGIN;
 
+  if (opts != NULL && _actor_placement(opts, &cpu, &node) != 0) {
+    ACCESS_ACTORS_END;
+    errno = EINVAL;
+    return ACTOR_INVALID;
+  }
+
   _actor_init_state(&state);
 
   assert(state != NULL);
 
   aid = state->myid;
+  state->parent = _actor_find_by_thread();
+  if (opts != NULL) {
+    assert(opts->mailbox_capacity >= 0);
+    assert(opts->mailbox_policy >= ACTOR_MAILBOX_BLOCK &&
+           opts->mailbox_policy <= ACTOR_MAILBOX_DROP_NEWEST);
+    assert(opts->guard_pages >= ACTOR_NO_GUARD);
+    assert(opts->placement >= ACTOR_PLACE_ANY &&
+           opts->placement <= ACTOR_PLACE_NEAR);
+    state->mailbox_capacity = opts->mailbox_capacity;
+    state->mailbox_policy = opts->mailbox_policy;
+    stack_size = opts->stack_size;
+    if (opts->guard_pages == ACTOR_NO_GUARD) {
+      guard_size = 0;
+    } else if (opts->guard_pages > 0) {
+      guard_size = opts->guard_pages * sysconf(_SC_PAGESIZE);
+    }
+  }
   si = (struct actor_spawn_info*)malloc(sizeof(struct actor_spawn_info));
   assert(si != NULL);
   si->state = state;
   si->fun = func;
   si->args = args;
 
+  if (actors_sched_mode == ACTOR_SCHED_FIBERS) {
+    ret = sched_spawn(state, spawn_actor_fiber, si);
+  } else {
+    state->cpu = cpu;
+    state->node = node;
+    ret = threads_run(spawn_actor_fun, si, stack_size, guard_size);
+  }
 
-  pthread_create(&state->thread, NULL, spawn_actor_fun, si);
+  if (ret != 0) {  /* out of threads or stacks */
+    _actor_destroy_state(state);
+    free(si);
+    aid = ACTOR_INVALID;
+  } else {
+    TRACE(TRACE_SPAWN, aid, state->parent, 0, 0, 0, 0);
+  }
 
   ACCESS_ACTORS_END;
 
   return aid;
 }
 
+int actor_numa_nodes() {
+  return topology_nodes();
+}
 
-/*------------------------------------------------------------------------------
-                                 helper functions
-------------------------------------------------------------------------------*/
+actor_id spawn_actor_handler(actor_handler_ptr_t handler, void *state) {
+  actor_state_t *st;
+  actor_id aid;
 
+  assert(handler != NULL);
 
-/* satisfies list_filter_func_ptr_t */
-int find_thread(void * item, void * arg) {
-  int ret = -1;
-  actor_state_t *st = (actor_state_t*)item;
-  if (PTHREAD_HANDLE(st->thread) == arg) ret = 0;
-  return ret;
+  ACCESS_ACTORS_BEGIN;
+
+  if (!sched_running() && sched_start(0) != 0) {
+    ACCESS_ACTORS_END;
+    return ACTOR_INVALID;
+  }
+
+  _actor_init_state(&st);
+  assert(st != NULL);
+
+  st->handler_state = state;
+  st->parent = _actor_find_by_thread();
+  __atomic_store_n(&st->handler, handler, __ATOMIC_SEQ_CST);
+  aid = st->myid;
+  TRACE(TRACE_SPAWN, aid, st->parent, 0, 0, 0, 0);
+
+  /* a sender that found the actor before `handler` was set did not
+     schedule it, so run it once to pick up anything already queued */
+  sched_wake(st);
+
+  ACCESS_ACTORS_END;
+
+  return aid;
 }
 
-/* satisfies list_filter_func_ptr_t */
-int find_by_id(void * item, void * arg) {
-  int ret = -1;
-  actor_state_t *st = ((actor_state_t*)item);
-  if (st->myid == (actor_id)arg) ret = 0;
-  return ret;
+void actor_trap_exit(int trap) {
+  actor_state_t *st = _actor_current();
+  if (st != NULL) __atomic_store_n(&st->trap_exit, trap != 0, __ATOMIC_RELEASE);
 }
 
-actor_id get_unique_actor_id() {
-  actor_id aid = -1;
-  actor_state_t *st;
+void actor_exit() {
+  actor_state_t *st = _actor_current();
+  if (st != NULL && st->handler != NULL) st->exiting = 1;
+}
+
+int _actor_run_handler(actor_state_t *st, int batch) {
+  long long start = ACTOR_STAT_CLOCK();
+  actor_msg_t *msg;
+  int result = SCHED_BUSY;
+  int x;
+
+  for (x = 0; x < batch; x++) {
+    if ((msg = _actor_mailbox_pop(st)) == NULL) {
+      /* a sender that is mid-push will not wake us again */
+      if (_actor_mailbox_empty(st)) result = SCHED_IDLE;
+      break;
+    }
+
+    st->handler(st->handler_state, msg);
+    _arelease(msg);
 
- find:
-  aid = rand();  /* TODO: use rand_r ? */
-  for (st = (actor_state_t*)*actor_list; st != NULL; st = st->next) {
-    if (st->myid == aid) goto find;
+    if (st->exiting) {
+      result = SCHED_DONE;
+      break;
+    }
   }
-  return aid;
+
+  /* timed per batch rather than per message to keep the clock reads down */
+  if (x > 0) ACTOR_STAT_ADD(st, stats_busy_ns, ACTOR_STAT_CLOCK() - start);
+  if (result == SCHED_DONE) _actor_exit(st);
+  return result;
 }
 
 
+/*------------------------------------------------------------------------------
+                                 helper functions
+------------------------------------------------------------------------------*/
 
-actor_id _actor_find_by_thread() {
-  actor_state_t *st = NULL;
-  actor_id aid = -1;
-  pthread_t thread = pthread_self();
 
-  st = list_filter(actor_list, find_thread, (void *) PTHREAD_HANDLE(thread));
-  if (st != NULL) aid = st->myid;
+actor_state_t *_actor_current() {
+  actor_state_t *st = current_actor;
+  return (st != NULL) ? st : sched_current();
+}
 
-  return aid;
+long long _actor_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+actor_id _actor_find_by_thread() {
+  actor_state_t *st = _actor_current();
+  return (st != NULL) ? st->myid : -1;
 }
 
 actor_id actor_self() {
-  actor_id aid = 0;
-  ACCESS_ACTORS_BEGIN;
-  aid = _actor_find_by_thread();
-  ACCESS_ACTORS_END;
-  return aid;
+  return _actor_find_by_thread();
 }
 
 
@@ -258,28 +609,91 @@ actor_id actor_self() {
 
 void _actor_init_state(actor_state_t **state) {
   actor_state_t *t;
+  int x;
   assert(state != NULL);
 
 
   t = (actor_state_t*)malloc(sizeof(actor_state_t));
-  t->myid = get_unique_actor_id();
+  assert(t != NULL);
   pthread_cond_init(&t->msg_cond, NULL);
   pthread_mutex_init(&t->msg_mutex, NULL);
-  list_init((list_item_t**)&t->messages);
-  list_init(&t->allocs);
-
-  list_append(actor_list, t);
+  for (x = 0; x < ACTOR_PRIO_LANES; x++) {
+    queue_init(&t->messages[x]);
+  }
+  t->sleeping = 0;
+  t->fiber = NULL;
+  t->handler = NULL;
+  t->handler_state = NULL;
+  t->scheduled = 0;
+  t->exiting = 0;
+  t->sched_next = NULL;
+  t->allocs = NULL;
+  pthread_mutex_init(&t->alloc_mutex, NULL);
+  t->stash_first = NULL;
+  t->stash_last = NULL;
+  t->stash_types = NULL;
+  t->stash_capacity = 0;
+  t->stash_used = 0;
+  t->match_type = 0;
+  t->match_wait = 0;
+  t->parent = ACTOR_INVALID;
+  t->trap_exit = 0;
+  t->mailbox_capacity = 0;
+  t->mailbox_policy = ACTOR_MAILBOX_BLOCK;
+  t->mailbox_depth = 0;
+  t->mailbox_dropped = 0;
+  t->mailbox_waiters = 0;
+  t->timer_fired = 0;
+  pthread_mutex_init(&t->shed_mutex, NULL);
+  t->mailbox_high_water = 0;
+  t->stats_sent = 0;
+  t->stats_received = 0;
+  t->stats_alloc_bytes = 0;
+  t->stats_wait_ns = 0;
+  t->stats_busy_ns = 0;
+  t->stats_wait_since = 0;
+  t->stats_started_ns = ACTOR_STAT_CLOCK();
+  t->pool = NULL;
+  t->pool_id = ACTOR_INVALID;
+  t->cpu = -1;
+  t->node = -1;
+
+  /* registry walks may find the state as soon as it is inserted */
+  t->myid = slotmap_insert(&actor_registry, t);
+  assert(t->myid != SLOTMAP_INVALID);
 
 
   *state = t;
 }
 
+/* called with actors_mutex held */
 void _actor_destroy_state(actor_state_t *state) {
   if (state == NULL) return;
 
+  /* senders look actors up without actors_mutex, so unregister first and
+     only free the state once every sender that found it is done */
+  slotmap_remove(&actor_registry, state->myid);
+  epoch_retire(state, _actor_free_state);
+}
+
+/* satisfies epoch_free_func_ptr_t */
+void _actor_free_state(void *arg) {
+  actor_state_t *state = (actor_state_t*)arg;
+  actor_msg_t *msg;
+
+  _actor_release_memory(state);
+
+  /* no sender can reach the mailbox any more, so nothing is mid-push */
+  while ((msg = _actor_mailbox_pop(state)) != NULL) {
+    _arelease(msg);
+  }
+  _actor_stash_destroy(state);
+  if (state->pool != NULL) _actor_pool_free(state->pool);
+
   pthread_cond_destroy(&state->msg_cond);
   pthread_mutex_destroy(&state->msg_mutex);
-  list_remove(actor_list, state);
+  pthread_mutex_destroy(&state->alloc_mutex);
+  pthread_mutex_destroy(&state->shed_mutex);
   free(state);
 }
 
@@ -293,13 +707,17 @@ actor_msg_t *_actor_create_msg(
     void *data,
     size_t size,
     actor_id sender,
-    actor_id dest,
-    pthread_t thread) {
+    actor_id dest) {
 
   void *newblock;
+  /* in flight messages have no owner; the receiver adopts them */
   actor_msg_t *msg =
-      (actor_msg_t *) _amalloc_thread(sizeof(actor_msg_t), thread);
-  newblock = _amalloc_thread(size, thread);
+      (actor_msg_t *) _amalloc_actor(sizeof(actor_msg_t), NULL);
+  ACTOR_BLOCK_HEADER(msg)->flags |= ACTOR_BLOCK_MSG;
+
+  if (size == 0) newblock = NULL;
+  else if (size <= ACTOR_MSG_INLINE_SIZE) newblock = msg->inline_data;
+  else newblock = _amalloc_actor(size, NULL);
 
   memcpy(newblock, data, size);
 
@@ -312,6 +730,30 @@ actor_msg_t *_actor_create_msg(
   return msg;
 }
 
+/* the message takes over the caller's reference to `block` */
+actor_msg_t *_actor_create_msg_owned(
+    long type,
+    void *block,
+    size_t size,
+    actor_id sender,
+    actor_id dest) {
+
+  actor_msg_t *msg =
+      (actor_msg_t *) _amalloc_actor(sizeof(actor_msg_t), NULL);
+  ACTOR_BLOCK_HEADER(msg)->flags |= ACTOR_BLOCK_MSG;
+
+  /* the sender's exit must not release the receiver's reference */
+  if (block != NULL) _actor_block_disown(ACTOR_BLOCK_HEADER(block));
+
+  msg->type = type;
+  msg->data = block;
+  msg->size = size;
+  msg->dest = dest;
+  msg->sender = sender;
+
+  return msg;
+}
+
 actor_msg_t *actor_receive() {
   return actor_receive_timeout(0);
 }
@@ -319,208 +761,2071 @@ actor_msg_t *actor_receive() {
 actor_msg_t *actor_receive_timeout(long timeout) {
   actor_state_t *st = NULL;
   actor_msg_t *msg = NULL;
-  pthread_t thread = pthread_self();
-  struct timespec ts;
-  struct timeval tp;
-
-  memset(&ts, 0, sizeof(struct timespec));
 
-  ACCESS_ACTORS_BEGIN;
   ACTOR_THREAD_PRINT("actor_receive_msg()\n");
 
-  st = list_filter(actor_list, find_thread, (void*)PTHREAD_HANDLE(thread));
+  st = _actor_current();
+  if (st == NULL || st->handler != NULL) return NULL;
 
-  if (st != NULL) {
-    msg = list_pop((list_item_t**)&st->messages);
+  msg = _actor_receive_wait(st, timeout);
 
-    pthread_mutex_lock(&st->msg_mutex);
+  /* released with the actor's memory unless the actor releases it first */
+  if (msg != NULL) _actor_block_adopt(st, ACTOR_BLOCK_HEADER(msg));
 
-    ACCESS_ACTORS_END;
+  return msg;
+}
 
-    if (msg == NULL) { /* no messages available, let's wait */
-      if (timeout > 0) {
-        gettimeofday(&tp, NULL);
-        ts.tv_sec  = tp.tv_sec;
-        ts.tv_nsec = (tp.tv_usec * 1000) + (timeout * 1000000);
-        if (pthread_cond_timedwait(
-                &st->msg_cond,
-                &st->msg_mutex, &ts) == 0) {
-          msg = list_pop((list_item_t**)&st->messages);
-        }
-      } else {
-        pthread_cond_wait(&st->msg_cond, &st->msg_mutex);
-      }
-      msg = list_pop((list_item_t**)&st->messages);
-    }
-    pthread_mutex_unlock(&st->msg_mutex);
-  } else {
-    ACCESS_ACTORS_END;
+int actor_receive_many(actor_msg_t **msgs, int max, long timeout) {
+  actor_state_t *st = _actor_current();
+  actor_block_t *b;
+  int count;
+  int x;
+
+  if (st == NULL || st->handler != NULL || max <= 0) return 0;
+
+  if ((msgs[0] = _actor_receive_wait(st, timeout)) == NULL) return 0;
+  for (count = 1; count < max; count++) {
+    if ((msgs[count] = _actor_pop(st)) == NULL) break;
   }
 
-  return msg;
-}
+  /* adopt the whole run under one acquisition of alloc_mutex */
+  pthread_mutex_lock(&st->alloc_mutex);
+  for (x = 0; x < count; x++) {
+    b = ACTOR_BLOCK_HEADER(msgs[x]);
+    b->prev = NULL;
+    b->next = st->allocs;
+    if (b->next != NULL) b->next->prev = b;
+    st->allocs = b;
+    __atomic_store_n(&b->owner, st, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&st->alloc_mutex);
 
-void actor_reply_msg(actor_msg_t *a, long type, void *data, size_t size) {
-  if (a == NULL) return;
-  actor_send_msg(a->sender, type, data, size);
+  return count;
 }
 
-void actor_broadcast_msg(long type, void *data, size_t size) {
-  actor_id *lst = NULL;
-  actor_state_t *st;
-  int count = 0;
-  int x = 0;
+actor_msg_t *actor_receive_match(long type, long timeout) {
+  actor_state_t *st = _actor_current();
+  actor_msg_t *msg;
 
-  ACCESS_ACTORS_BEGIN;
+  if (st == NULL || st->handler != NULL) return NULL;
 
-  count = list_count(actor_list);
-  lst = _amalloc_thread(sizeof(actor_id) * count, pthread_self());
-  for (st = (actor_state_t*)*actor_list; st != NULL; st = st->next) {
-    lst[x] = st->myid;
-    x++;
-  }
+  msg = _actor_receive_match(st, type, NULL, NULL, timeout);
+  if (msg != NULL) _actor_block_adopt(st, ACTOR_BLOCK_HEADER(msg));
 
-  ACCESS_ACTORS_END;
+  return msg;
+}
 
-  for (x = 0; x < count; x++) {
-    actor_send_msg(lst[x], type, data, size);
-  }
+actor_msg_t *actor_receive_match_fn(
+    actor_match_func_ptr_t match,
+    void *arg,
+    long timeout) {
+
+  actor_state_t *st = _actor_current();
+  actor_msg_t *msg;
+
+  assert(match != NULL);
+  if (st == NULL || st->handler != NULL) return NULL;
 
-  arelease(lst);
+  msg = _actor_receive_match(st, 0, match, arg, timeout);
+  if (msg != NULL) _actor_block_adopt(st, ACTOR_BLOCK_HEADER(msg));
+
+  return msg;
 }
 
-void actor_send_msg(actor_id aid, long type, void *data, size_t size) {
-  ACCESS_ACTORS_BEGIN;
-  _actor_send_msg(aid, type, data, size);
-  ACCESS_ACTORS_END;
+void _actor_deadline_init(struct actor_deadline *d, long timeout) {
+  d->timeout = timeout;
+  d->timer = WHEEL_INVALID;
+  if (timeout > 0) d->expires = wheel_deadline(timeout);
 }
 
-void _actor_send_msg(actor_id aid, long type, void *data, size_t size) {
-  actor_state_t *st = NULL;
-  actor_msg_t *msg = NULL;
-  actor_id myid = _actor_find_by_thread();
-  pthread_t thread;
-  PTHREAD_HANDLE(thread) = NULL;
+void _actor_deadline_done(struct actor_deadline *d) {
+  if (d->timer != WHEEL_INVALID) wheel_cancel(d->timer);
+}
 
-  if (myid == -1) return;
+/* satisfies wheel_func_ptr_t; `arg` is the waiting actor's id */
+void _actor_timeout_fire(void *arg, int fired) {
+  actor_state_t *st;
 
-  st = list_filter(actor_list, find_by_id, (void*)aid);
+  if (!fired) return;
 
-  if (st != NULL) {
-    pthread_mutex_lock(&st->msg_mutex);
-    msg = _actor_create_msg(type, data, size, myid, aid, st->thread);
-    list_append((list_item_t**)&st->messages, msg);
-    pthread_cond_signal(&st->msg_cond);
-    pthread_mutex_unlock(&st->msg_mutex);
+  epoch_enter();
+  if ((st = slotmap_get(&actor_registry, (actor_id)arg)) != NULL) {
+    __atomic_store_n(&st->timer_fired, 1, __ATOMIC_SEQ_CST);
+    _actor_wake(st);
   }
+  epoch_exit();
 }
 
+/*
+  Called once the mailbox has been found empty: blocks until something
+  may have arrived or the deadline passes. Returns nonzero on timeout.
 
-/*------------------------------------------------------------------------------
-                                memory management
-------------------------------------------------------------------------------*/
-
-void *_amalloc_thread(size_t size, pthread_t thread) {
-  alloc_info_t *info;
-  void *block = NULL;
-  actor_state_t *st = NULL;
-  struct actor_alloc *al;
+  A timed wait arms a timer on the wheel that sets `timer_fired` and
+  wakes the actor; whether the receive has timed out is then decided by
+  the clock, so a timer left over from an earlier receive only causes
+  one extra trip round the caller's loop.
+*/
+int _actor_wait(actor_state_t *st, struct actor_deadline *d) {
+  long long start;
 
+  if (!_actor_mailbox_empty(st)) { /* a sender is mid-push */
+    if (st->fiber != NULL) sched_fiber_yield();
+    else sched_yield();
+    return 0;
+  }
 
-  if (size == 0) return NULL;
-  pthread_mutex_lock(&actors_alloc);
-  block = malloc(size);
-  assert(block != NULL);
-  info = (alloc_info_t*)malloc(sizeof(alloc_info_t));
-  info->block = block;
-  info->refcount = 1;
-
-  st = list_filter(actor_list, find_thread, (void*)PTHREAD_HANDLE(thread));
-  if (st != NULL) {
-    al = (struct actor_alloc*)malloc(sizeof(struct actor_alloc));
-    assert(al != NULL);
-    al->block = block;
-    list_append(&st->allocs, al);
+  if (d->timeout > 0) {
+    if (wheel_now() >= d->expires) return 1;
+    if (d->timer == WHEEL_INVALID) {
+      d->timer = wheel_arm(d->expires, _actor_timeout_fire, (void*)st->myid);
+    }
+    if (d->timer == WHEEL_INVALID) { /* no timer thread: poll */
+      if (st->fiber != NULL) sched_fiber_yield();
+      else sched_yield();
+      return 0;
+    }
   }
 
-  list_append(alloc_list, info);
+  if (__atomic_exchange_n(&st->timer_fired, 0, __ATOMIC_SEQ_CST)) return 0;
 
-  pthread_mutex_unlock(&actors_alloc);
+  start = ACTOR_STAT_CLOCK();
+  ACTOR_STAT_SET(st, stats_wait_since, start);
+  TRACE(TRACE_BLOCK, st->myid, ACTOR_INVALID, 0, 0, 0, 0);
+  if (st->fiber != NULL) {
+    sched_park(st);
+  } else {
+    /* no messages available, let's wait. Senders only take msg_mutex
+       when they see `sleeping`, which they check after pushing, so
+       re-checking the queue here cannot miss a wakeup; the same goes for
+       timers and `timer_fired`. */
+    pthread_mutex_lock(&st->msg_mutex);
+    __atomic_store_n(&st->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (_actor_mailbox_empty(st) &&
+        !__atomic_load_n(&st->timer_fired, __ATOMIC_SEQ_CST)) {
+      pthread_cond_wait(&st->msg_cond, &st->msg_mutex);
+    }
+    __atomic_store_n(&st->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&st->msg_mutex);
+  }
+  ACTOR_STAT_ADD(st, stats_wait_ns, ACTOR_STAT_CLOCK() - start);
+  ACTOR_STAT_SET(st, stats_wait_since, 0);
+  TRACE(TRACE_UNBLOCK, st->myid, ACTOR_INVALID, 0, 0, 0, 0);
 
-  return block;
+  return 0;
 }
 
+/* the first message of the highest non-empty lane */
+actor_msg_t *_actor_mailbox_pop(actor_state_t *st) {
+  actor_msg_t *msg;
+  int lane;
 
-/* satisfies list_filter_func_ptr_t */
-int find_memory(void * info, void * block) {
-  if (((alloc_info_t*)info)->block == block) return 0;
-  return -1;
+  for (lane = ACTOR_PRIO_LANES - 1; lane >= 0; lane--) {
+    if ((msg = _actor_lane_pop(st, lane)) != NULL) return msg;
+  }
+  return NULL;
 }
 
-/* satisfies list_filter_func_ptr_t */
-int find_actor_block(void * info, void * arg) {
-  return (((struct actor_alloc *) info)->block == arg) ? 0 : -1;
+/* pops from one lane and gives the message's room back to senders */
+actor_msg_t *_actor_lane_pop(actor_state_t *st, int lane) {
+  actor_msg_t *msg;
+  long depth;
+
+  if (st->mailbox_policy == ACTOR_MAILBOX_DROP_OLDEST &&
+      st->mailbox_capacity > 0) {
+    pthread_mutex_lock(&st->shed_mutex);
+    msg = queue_pop(&st->messages[lane]);
+    pthread_mutex_unlock(&st->shed_mutex);
+  } else {
+    msg = queue_pop(&st->messages[lane]);
+  }
+  if (msg == NULL) return NULL;
+
+  /* seq_cst: pairs with the waiter count in _actor_mailbox_wait() */
+  depth = __atomic_sub_fetch(&st->mailbox_depth, 1, __ATOMIC_SEQ_CST);
+  ACTOR_STAT_ADD(st, stats_received, 1);
+  TRACE(TRACE_DEQUEUE, st->myid, msg->sender, msg->type, msg->size, depth,
+        (unsigned long)msg);
+#if !defined(ACTOR_NO_STATS)
+  /* only pops lower the depth, so its peak since the last pop is what
+     this one found; actor_stats() adds the depth reached since then */
+  if (depth + 1 > st->mailbox_high_water) {
+    __atomic_store_n(&st->mailbox_high_water, depth + 1, __ATOMIC_RELAXED);
+  }
+#endif  // !defined(ACTOR_NO_STATS)
+  if (depth < st->mailbox_capacity &&
+      __atomic_load_n(&st->mailbox_waiters, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&mailbox_space_mutex);
+    pthread_cond_broadcast(&mailbox_space_cond);
+    pthread_mutex_unlock(&mailbox_space_mutex);
+  }
+  return msg;
 }
 
+/* false while any lane has a message, or a sender is mid-push to one */
+int _actor_mailbox_empty(actor_state_t *st) {
+  int shedding = st->mailbox_policy == ACTOR_MAILBOX_DROP_OLDEST &&
+      st->mailbox_capacity > 0;
+  int empty = 1;
+  int lane;
 
-void arelease(void *block) {
-  pthread_t thread = pthread_self();
-  ACCESS_ACTORS_BEGIN;
-  ACTOR_THREAD_PRINT("arelease()");
-  _arelease(block, thread);
-  ACCESS_ACTORS_END;
+  if (shedding) pthread_mutex_lock(&st->shed_mutex);
+  for (lane = 0; lane < ACTOR_PRIO_LANES && empty; lane++) {
+    empty = queue_empty(&st->messages[lane]);
+  }
+  if (shedding) pthread_mutex_unlock(&st->shed_mutex);
+  return empty;
 }
 
-void _arelease(void *block, pthread_t thread) {
-  alloc_info_t *info = NULL;
-  actor_state_t *st = NULL;
-  struct actor_alloc *al;
+int _actor_wakeup_pending(actor_state_t *st) {
+  return !_actor_mailbox_empty(st) ||
+      __atomic_load_n(&st->timer_fired, __ATOMIC_SEQ_CST);
+}
 
-  if (block == NULL) return;
+/*
+  Reserves room for one message in st's mailbox, applying the mailbox
+  policy if it is full. Called inside an epoch section that `st` was
+  looked up in. ACTOR_ADMIT_OK means the caller must push the message,
+  ACTOR_ADMIT_DROPPED that it must discard it; ACTOR_ADMIT_FULL is only
+  returned in ACTOR_SEND_WAIT and ACTOR_SEND_TRY mode.
+*/
+int _actor_mailbox_admit(actor_state_t *self, actor_state_t *st, int mode) {
+  long capacity = st->mailbox_capacity;
+  long depth;
 
-  pthread_mutex_lock(&actors_alloc);
+  if (capacity == 0) {
+    __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+    return ACTOR_ADMIT_OK;
+  }
 
-  if ((info = list_filter(alloc_list, find_memory, block)) != NULL) {
-    info->refcount--;
-    if (info->refcount == 0) { /* time to destroy this block */
-      free(info->block);
-      list_remove(alloc_list, info);
-      free(info);
+  depth = __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED);
+  while (depth < capacity) {
+    if (__atomic_compare_exchange_n(
+            &st->mailbox_depth, &depth, depth + 1, 1,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return ACTOR_ADMIT_OK;
     }
   }
 
-  pthread_mutex_unlock(&actors_alloc);
-
-  st = list_filter(actor_list, find_thread, (void*)PTHREAD_HANDLE(thread));
-  if (st != NULL) {
-    if ((al = list_filter(&st->allocs, find_actor_block, block)) != NULL) {
-      list_remove(&st->allocs, al);
-      free(al);
-    }
+  switch (st->mailbox_policy) {
+    case ACTOR_MAILBOX_DROP_OLDEST:
+      /* the new message takes over the room of the one shed; if the
+         receiver emptied the lanes meanwhile, there is room anyway */
+      if (!_actor_mailbox_shed(st)) {
+        __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+      }
+      return ACTOR_ADMIT_OK;
+    case ACTOR_MAILBOX_BLOCK:
+      if (mode == ACTOR_SEND_WAIT && (self == st || self->handler != NULL)) {
+        /* nobody else would make room while these wait */
+        __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+        return ACTOR_ADMIT_OK;
+      }
+      if (mode != ACTOR_SEND_NOWAIT) return ACTOR_ADMIT_FULL;
+      break;
+    case ACTOR_MAILBOX_FAIL:
+      if (mode == ACTOR_SEND_TRY) return ACTOR_ADMIT_FULL;
+      break;
   }
-}
 
-/* satisfies list_filter_func_ptr_t */
-int find_memory_actor(void * owner, void * arg) {
-  return (owner == arg) ? 0 : -1;
+  __atomic_fetch_add(&st->mailbox_dropped, 1, __ATOMIC_RELAXED);
+  return ACTOR_ADMIT_DROPPED;
 }
 
-void _actor_release_memory(actor_state_t *state) {
-  struct actor_alloc *info, *tmp;
-#ifdef DEBUG_MEMORY
-  int count = list_count(&state->allocs);
-  if (count > 0) {
-    printf(
-        "_actor_release_memory(): "
-        "automatically releasing %d allocations. "
-        "(actor_id = %d)\n",
-        count,
-        (int)state->myid);
+/*
+  Discards the oldest message of the lowest non-empty lane. Senders only
+  pop under shed_mutex, which the receiver then takes as well.
+*/
+int _actor_mailbox_shed(actor_state_t *st) {
+  actor_msg_t *msg = NULL;
+  int lane;
+
+  pthread_mutex_lock(&st->shed_mutex);
+  for (lane = 0; lane < ACTOR_PRIO_LANES && msg == NULL; lane++) {
+    msg = queue_pop(&st->messages[lane]);
+  }
+  pthread_mutex_unlock(&st->shed_mutex);
+
+  if (msg == NULL) return 0;
+  _arelease(msg);
+  __atomic_fetch_add(&st->mailbox_dropped, 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/*
+  Waits until the mailbox of `aid` may have room, or the actor is gone.
+  Called outside any epoch section, since waiting inside one would hold
+  back reclamation. Fibers yield to their worker and retry; threads sleep
+  on mailbox_space_cond, which receivers signal under mailbox_space_mutex
+  when they pop from a mailbox with waiters, or exit.
+*/
+void _actor_mailbox_wait(actor_state_t *self, actor_id aid) {
+  actor_state_t *st;
+  int full = 0;
+
+  if (self->fiber != NULL) {
+    sched_fiber_yield();
+    return;
+  }
+
+  pthread_mutex_lock(&mailbox_space_mutex);
+
+  epoch_enter();
+  if ((st = slotmap_get(&actor_registry, aid)) != NULL) {
+    __atomic_fetch_add(&st->mailbox_waiters, 1, __ATOMIC_SEQ_CST);
+    full = __atomic_load_n(&st->mailbox_depth, __ATOMIC_SEQ_CST) >=
+        st->mailbox_capacity;
+  }
+  epoch_exit();
+
+  if (st == NULL) {
+    pthread_mutex_unlock(&mailbox_space_mutex);
+    return;
+  }
+  if (full) pthread_cond_wait(&mailbox_space_cond, &mailbox_space_mutex);
+
+  epoch_enter();
+  if ((st = slotmap_get(&actor_registry, aid)) != NULL) {
+    __atomic_fetch_sub(&st->mailbox_waiters, 1, __ATOMIC_SEQ_CST);
+  }
+  epoch_exit();
+
+  pthread_mutex_unlock(&mailbox_space_mutex);
+}
+
+/*
+  The next message to receive: high priority messages overtake those
+  set aside by actor_receive_match(), which come before the rest of the
+  mailbox since they arrived first.
+*/
+actor_msg_t *_actor_pop(actor_state_t *st) {
+  actor_msg_t *msg = _actor_lane_pop(st, ACTOR_PRIO_HIGH);
+
+  if (msg != NULL) return msg;
+  if (st->stash_first != NULL) return _actor_stash_take_first(st);
+  return _actor_mailbox_pop(st);
+}
+
+/* pops the next message, waiting up to `timeout` ms (forever if <= 0) */
+actor_msg_t *_actor_receive_wait(actor_state_t *st, long timeout) {
+  struct actor_deadline d;
+  actor_msg_t *msg;
+
+  _actor_deadline_init(&d, timeout);
+  while ((msg = _actor_pop(st)) == NULL) {
+    if (_actor_wait(st, &d)) {
+      msg = _actor_pop(st);
+      break;
+    }
+  }
+  _actor_deadline_done(&d);
+
+  return msg;
+}
+
+/*
+  Takes the oldest message of `type`, or the oldest one `match` accepts if
+  it is not NULL. Messages that do not match are set aside in the stash.
+*/
+actor_msg_t *_actor_receive_match(
+    actor_state_t *st,
+    long type,
+    actor_match_func_ptr_t match,
+    void *arg,
+    long timeout) {
+
+  struct actor_deadline d;
+  actor_msg_t *msg;
+  int timed_out = 0;
+
+  if (match != NULL) msg = _actor_stash_take_match(st, match, arg);
+  else msg = _actor_stash_take_type(st, type);
+  if (msg != NULL) return msg;
+
+  /* senders of other types need not wake us (see _actor_notify) */
+  if (match == NULL) {
+    __atomic_store_n(&st->match_type, type, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&st->match_wait, 1, __ATOMIC_SEQ_CST);
+  }
+
+  _actor_deadline_init(&d, timeout);
+  for (;;) {
+    while ((msg = _actor_mailbox_pop(st)) != NULL) {
+      if (match != NULL ? match(msg, arg) : msg->type == type) goto found;
+      _actor_stash_put(st, msg);
+    }
+    if (timed_out) break;
+    timed_out = _actor_wait(st, &d);
+  }
+
+found:
+  _actor_deadline_done(&d);
+  if (match == NULL) __atomic_store_n(&st->match_wait, 0, __ATOMIC_SEQ_CST);
+  return msg;
+}
+
+/* like _actor_wake(), but leaves alone a receiver waiting for another type */
+void _actor_notify(actor_state_t *st, long type) {
+  if (__atomic_load_n(&st->match_wait, __ATOMIC_SEQ_CST) &&
+      __atomic_load_n(&st->match_type, __ATOMIC_SEQ_CST) != type) {
+    return;
+  }
+  _actor_wake(st);
+}
+
+/* called after pushing to st's mailbox */
+void _actor_wake(actor_state_t *st) {
+  /* seq_cst: a fiber spawned concurrently may not have published it yet */
+  if (__atomic_load_n(&st->fiber, __ATOMIC_SEQ_CST) != NULL ||
+      __atomic_load_n(&st->handler, __ATOMIC_SEQ_CST) != NULL) {
+    sched_wake(st);
+  } else if (__atomic_load_n(&st->sleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&st->msg_mutex);
+    pthread_cond_signal(&st->msg_cond);
+    pthread_mutex_unlock(&st->msg_mutex);
+  }
+}
+
+void actor_reply_msg(actor_msg_t *a, long type, void *data, size_t size) {
+  if (a == NULL) return;
+  actor_send_msg(a->sender, type, data, size);
+}
+
+/*
+  Fan-out helpers: payloads too large to inline are copied once into a
+  shared block, and every recipient's message takes a reference to it.
+*/
+void *_actor_fanout_begin(void *data, size_t size) {
+  void *shared;
+
+  if (size <= ACTOR_MSG_INLINE_SIZE) return NULL;
+  shared = _amalloc_actor(size, NULL);
+  memcpy(shared, data, size);
+  return shared;
+}
+
+/*
+  Called inside an epoch section that `st` was looked up in. Returns
+  nonzero if the message was queued rather than dropped by st's policy.
+*/
+int _actor_fanout_send(
+    actor_state_t *st,
+    actor_id sender,
+    long type,
+    void *data,
+    void *shared,
+    size_t size) {
+
+  actor_msg_t *msg;
+
+  if (_actor_mailbox_admit(NULL, st, ACTOR_SEND_NOWAIT) != ACTOR_ADMIT_OK) {
+    return 0;
+  }
+
+  if (shared != NULL) {
+    aretain(shared);
+    msg = _actor_create_msg_owned(type, shared, size, sender, st->myid);
+  } else {
+    msg = _actor_create_msg(type, data, size, sender, st->myid);
+  }
+  TRACE(TRACE_SEND, sender, st->myid, type, size, 0, (unsigned long)msg);
+  queue_push(&st->messages[ACTOR_PRIO_NORMAL], msg);
+  TRACE(TRACE_ENQUEUE, st->myid, sender, type, size,
+        __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED), 0);
+  _actor_notify(st, type);
+  return 1;
+}
+
+void actor_broadcast_msg(long type, void *data, size_t size) {
+  actor_state_t *st;
+  actor_state_t *self = _actor_current();
+  void *shared;
+  long cursor = 0;
+  long sent = 0;
+
+  if (self == NULL) return;
+
+  shared = _actor_fanout_begin(data, size);
+
+  /* the registry can be walked without actors_mutex; the epoch keeps
+     every state we find allocated until we are done with it */
+  epoch_enter();
+  while ((st = slotmap_next(&actor_registry, &cursor)) != NULL) {
+    /* a pool's members get their own copies */
+    if (__atomic_load_n(&st->pool, __ATOMIC_ACQUIRE) != NULL) continue;
+    sent += _actor_fanout_send(st, self->myid, type, data, shared, size);
+  }
+  epoch_exit();
+  ACTOR_STAT_ADD(self, stats_sent, sent);
+
+  arelease(shared);
+}
+
+void actor_send_msg(actor_id aid, long type, void *data, size_t size) {
+  _actor_send_msg(
+      aid, type, type, data, size, ACTOR_PRIO_NORMAL, ACTOR_SEND_WAIT);
+}
+
+int actor_try_send(actor_id aid, long type, void *data, size_t size) {
+  return _actor_send_msg(
+      aid, type, type, data, size, ACTOR_PRIO_NORMAL, ACTOR_SEND_TRY);
+}
+
+void actor_send_keyed(
+    actor_id aid,
+    unsigned long key,
+    long type,
+    void *data,
+    size_t size) {
+
+  _actor_send_msg(
+      aid, key, type, data, size, ACTOR_PRIO_NORMAL, ACTOR_SEND_WAIT);
+}
+
+void actor_send_msg_prio(
+    actor_id aid,
+    long type,
+    void *data,
+    size_t size,
+    int prio) {
+
+  assert(prio >= 0 && prio < ACTOR_PRIO_LANES);
+  _actor_send_msg(aid, type, type, data, size, prio, ACTOR_SEND_WAIT);
+}
+
+int actor_mailbox_stats(actor_id aid, actor_mailbox_stats_t *stats) {
+  actor_state_t *st;
+
+  epoch_enter();
+  if ((st = slotmap_get(&actor_registry, aid)) != NULL) {
+    stats->depth = __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED);
+    stats->capacity = st->mailbox_capacity;
+    stats->dropped = __atomic_load_n(&st->mailbox_dropped, __ATOMIC_RELAXED);
+  }
+  epoch_exit();
+
+  if (st == NULL) {
+    errno = ESRCH;
+    return -1;
+  }
+  return 0;
+}
+
+/* called inside an epoch section that `st` was looked up in */
+void _actor_stats_fill(actor_state_t *st, actor_stats_t *stats) {
+  long long started = st->stats_started_ns;
+  long long since;
+
+  stats->id = st->myid;
+  stats->sent = __atomic_load_n(&st->stats_sent, __ATOMIC_RELAXED);
+  stats->received = __atomic_load_n(&st->stats_received, __ATOMIC_RELAXED);
+  stats->mailbox_depth = __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED);
+  stats->mailbox_capacity = st->mailbox_capacity;
+  stats->mailbox_high_water =
+      __atomic_load_n(&st->mailbox_high_water, __ATOMIC_RELAXED);
+  if (stats->mailbox_depth > stats->mailbox_high_water) {
+    stats->mailbox_high_water = stats->mailbox_depth;
+  }
+  stats->mailbox_dropped =
+      __atomic_load_n(&st->mailbox_dropped, __ATOMIC_RELAXED);
+  stats->alloc_bytes =
+      __atomic_load_n(&st->stats_alloc_bytes, __ATOMIC_RELAXED);
+  stats->wait_ns = __atomic_load_n(&st->stats_wait_ns, __ATOMIC_RELAXED);
+  stats->busy_ns = __atomic_load_n(&st->stats_busy_ns, __ATOMIC_RELAXED);
+
+  /* include a wait still in progress; thread and fiber actors are busy
+     whenever they are not waiting. The counters are read one by one, so
+     the sums are approximate while the actor runs. */
+  if (__atomic_load_n(&st->handler, __ATOMIC_RELAXED) == NULL &&
+      started != 0) {
+    since = __atomic_load_n(&st->stats_wait_since, __ATOMIC_RELAXED);
+    if (since != 0) stats->wait_ns += ACTOR_STAT_CLOCK() - since;
+    stats->busy_ns = ACTOR_STAT_CLOCK() - started - stats->wait_ns;
+    if (stats->busy_ns < 0) stats->busy_ns = 0;
+  }
+}
+
+int actor_stats(actor_id aid, actor_stats_t *stats) {
+  actor_state_t *st;
+
+  epoch_enter();
+  if ((st = slotmap_get(&actor_registry, aid)) != NULL) {
+    _actor_stats_fill(st, stats);
+  }
+  epoch_exit();
+
+  if (st == NULL) {
+    errno = ESRCH;
+    return -1;
+  }
+  return 0;
+}
+
+int actor_stats_snapshot(actor_stats_t *stats, int max) {
+  actor_state_t *st;
+  long cursor = 0;
+  int count = 0;
+
+  /* like actor_broadcast_msg(), this walks the registry without
+     actors_mutex, so spawns and exits carry on meanwhile */
+  epoch_enter();
+  while ((st = slotmap_next(&actor_registry, &cursor)) != NULL) {
+    if (__atomic_load_n(&st->pool, __ATOMIC_ACQUIRE) != NULL) continue;
+    if (count < max) _actor_stats_fill(st, &stats[count]);
+    count++;
+  }
+  epoch_exit();
+
+  return count;
+}
+
+/* the messages of a batch bound for one actor, pool members included */
+struct actor_batch_group {
+  actor_id dest;  /* st's id, still usable once the epoch is left */
+  actor_state_t *st;
+  actor_msg_t *first;
+  actor_msg_t *last;
+  long count;
+  long counted;  /* of count, already added to an unbounded mailbox_depth */
+  int deferred;  /* first entry that found the mailbox full, or -1 */
+};
+
+int actor_send_batch(actor_send_entry_t *entries, int count) {
+  struct actor_batch_group stack_groups[ACTOR_BATCH_STACK];
+  int stack_slots[ACTOR_BATCH_STACK * 2];
+  int stack_routes[ACTOR_BATCH_STACK];
+  struct actor_batch_group *groups = stack_groups;
+  struct actor_batch_group *g;
+  int *slots = stack_slots;
+  int *routes = stack_routes;  /* each entry's group, or -1 */
+  int nslots = ACTOR_BATCH_STACK * 2;
+  int ngroups = 0;
+  int delivered = 0;
+  unsigned long h;
+  actor_msg_t *msg;
+  actor_state_t *st;
+  actor_state_t *self = _actor_current();
+  int admit;
+  int x, y;
+
+  if (self == NULL || count <= 0) return 0;
+
+  if (count > ACTOR_BATCH_STACK) {
+    for (nslots = ACTOR_BATCH_STACK * 2; nslots < count * 2; nslots *= 2) {}
+    groups = (struct actor_batch_group*)malloc(
+        sizeof(struct actor_batch_group) * count);
+    slots = (int*)malloc(sizeof(int) * nslots);
+    routes = (int*)malloc(sizeof(int) * count);
+    assert(groups != NULL && slots != NULL && routes != NULL);
+  }
+  memset(slots, -1, sizeof(int) * nslots);
+
+  epoch_enter();
+
+  /* each entry is routed on its own, so that a batch sent to a pool is
+     spread over its members; the entries are then grouped by the actor
+     they resolved to, through an open-addressed table of group indexes */
+  for (x = 0; x < count; x++) {
+    routes[x] = -1;
+    st = _actor_lookup(entries[x].dest, (unsigned long)entries[x].type);
+    if (st == NULL) continue;
+
+    h = ((unsigned long)st->myid * 0x9E3779B97F4A7C15UL) >> 32;
+    for (h &= nslots - 1; slots[h] != -1; h = (h + 1) & (nslots - 1)) {
+      if (groups[slots[h]].st == st) break;
+    }
+    if (slots[h] == -1) {
+      slots[h] = ngroups;
+      g = &groups[ngroups++];
+      g->dest = st->myid;
+      g->st = st;
+      g->first = NULL;
+      g->last = NULL;
+      g->count = 0;
+      g->counted = 0;
+      g->deferred = -1;
+    }
+    routes[x] = slots[h];
+    g = &groups[slots[h]];
+    if (g->deferred != -1) continue;
+
+    /* unbounded mailboxes are accounted for once per group below */
+    if (g->st->mailbox_capacity > 0) {
+      admit = _actor_mailbox_admit(self, g->st, ACTOR_SEND_WAIT);
+      if (admit == ACTOR_ADMIT_DROPPED) continue;
+      if (admit == ACTOR_ADMIT_FULL) {
+        g->deferred = x;
+        continue;
+      }
+    }
+
+    msg = _actor_create_msg(
+        entries[x].type,
+        entries[x].data,
+        entries[x].size,
+        self->myid,
+        g->st->myid);
+    TRACE(TRACE_SEND, self->myid, g->st->myid, entries[x].type,
+          entries[x].size, 0, (unsigned long)msg);
+    if (g->first == NULL) g->first = msg;
+    else g->last->next = msg;
+    g->last = msg;
+    g->count++;
+    delivered++;
+
+    /* routing by load must see the messages this batch already gave the
+       member; bounded mailboxes were counted by the admission above */
+    if (st->mailbox_capacity == 0 && st->myid != entries[x].dest) {
+      __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+      g->counted++;
+    }
+  }
+
+  for (x = 0; x < ngroups; x++) {
+    g = &groups[x];
+    if (g->first == NULL) continue;
+    if (g->st->mailbox_capacity == 0 && g->count > g->counted) {
+      __atomic_fetch_add(
+          &g->st->mailbox_depth,
+          g->count - g->counted,
+          __ATOMIC_RELAXED);
+    }
+    queue_push_chain(
+        &g->st->messages[ACTOR_PRIO_NORMAL],
+        g->first,
+        g->last);
+    TRACE(TRACE_ENQUEUE, g->st->myid, self->myid, 0, 0,
+          __atomic_load_n(&g->st->mailbox_depth, __ATOMIC_RELAXED), 0);
+    _actor_wake(g->st);
+  }
+
+  epoch_exit();
+  ACTOR_STAT_ADD(self, stats_sent, delivered);
+
+  /* the rest of a group that filled an ACTOR_MAILBOX_BLOCK mailbox waits
+     for room one message at a time, in entry order; entries routed to a
+     pool member stay with that member */
+  for (x = 0; x < ngroups; x++) {
+    g = &groups[x];
+    for (y = g->deferred; y != -1 && y < count; y++) {
+      if (routes[y] != x) continue;
+      if (_actor_send_msg(
+              g->dest,
+              entries[y].type,
+              entries[y].type,
+              entries[y].data,
+              entries[y].size,
+              ACTOR_PRIO_NORMAL,
+              ACTOR_SEND_WAIT) == 0) {
+        delivered++;
+      }
+    }
+  }
+
+  if (groups != stack_groups) {
+    free(groups);
+    free(slots);
+    free(routes);
+  }
+  return delivered;
+}
+
+void actor_send_owned(actor_id aid, long type, void *block, size_t size) {
+  _actor_send_owned(aid, type, block, size);
+}
+
+/*
+  Returns 0 once the message is queued, or dropped by the receiver's
+  policy; otherwise -1 with errno set as described for actor_try_send().
+*/
+int _actor_send_msg(
+    actor_id aid,
+    unsigned long key,
+    long type,
+    void *data,
+    size_t size,
+    int prio,
+    int mode) {
+
+  actor_state_t *st = NULL;
+  actor_msg_t *msg = NULL;
+  actor_state_t *self = _actor_current();
+  actor_id dest = aid;
+  int admit = ACTOR_ADMIT_DROPPED;
+
+  if (self == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  for (;;) {
+    epoch_enter();
+
+    /* stale ids fail the generation check, so dead actors are skipped */
+    st = _actor_lookup(aid, key);
+
+    if (st != NULL) {
+      dest = st->myid;
+      admit = _actor_mailbox_admit(self, st, mode);
+    }
+    if (st != NULL && admit == ACTOR_ADMIT_OK) {
+      msg = _actor_create_msg(type, data, size, self->myid, dest);
+      TRACE(TRACE_SEND, self->myid, dest, type, size, 0, (unsigned long)msg);
+      queue_push(&st->messages[prio], msg);
+      TRACE(TRACE_ENQUEUE, dest, self->myid, type, size,
+            __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED), 0);
+      _actor_notify(st, type);
+      ACTOR_STAT_ADD(self, stats_sent, 1);
+    }
+
+    epoch_exit();
+
+    if (st == NULL || admit != ACTOR_ADMIT_FULL || mode != ACTOR_SEND_WAIT) {
+      break;
+    }
+    _actor_mailbox_wait(self, dest);
+  }
+
+  if (st == NULL) {
+    errno = ESRCH;
+    return -1;
+  }
+  if (admit == ACTOR_ADMIT_FULL) {
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+void _actor_send_owned(actor_id aid, long type, void *block, size_t size) {
+  actor_state_t *st = NULL;
+  actor_msg_t *msg = NULL;
+  actor_state_t *self = _actor_current();
+  actor_id dest = aid;
+  int admit = ACTOR_ADMIT_DROPPED;
+
+  if (self == NULL) {
+    _arelease(block);
+    return;
+  }
+
+  for (;;) {
+    epoch_enter();
+
+    st = _actor_lookup(aid, (unsigned long)type);
+
+    if (st != NULL) {
+      dest = st->myid;
+      admit = _actor_mailbox_admit(self, st, ACTOR_SEND_WAIT);
+    }
+    if (st != NULL && admit == ACTOR_ADMIT_OK) {
+      msg = _actor_create_msg_owned(type, block, size, self->myid, dest);
+      TRACE(TRACE_SEND, self->myid, dest, type, size, 0, (unsigned long)msg);
+      queue_push(&st->messages[ACTOR_PRIO_NORMAL], msg);
+      TRACE(TRACE_ENQUEUE, dest, self->myid, type, size,
+            __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED), 0);
+      _actor_notify(st, type);
+      ACTOR_STAT_ADD(self, stats_sent, 1);
+    }
+
+    epoch_exit();
+
+    if (st == NULL || admit != ACTOR_ADMIT_FULL) break;
+    _actor_mailbox_wait(self, dest);
+  }
+
+  if (st == NULL || admit == ACTOR_ADMIT_DROPPED) _arelease(block);
+}
+
+
+/*------------------------------------------------------------------------------
+                                     stash
+------------------------------------------------------------------------------*/
+
+/*
+  Messages skipped by actor_receive_match() wait in the receiver's stash.
+  They are kept in arrival order on a list threaded through their block
+  headers (unused until the receiver adopts the message), and in a FIFO
+  per type threaded through msg->next, found through an open-addressed
+  table. Only the receiver touches its stash.
+*/
+
+struct actor_stash_type {
+  long type;
+  actor_msg_t *head;  /* oldest stashed message of this type */
+  actor_msg_t *tail;
+  int used;
+};
+
+/* the slot for `type`, or the free slot it would go in */
+struct actor_stash_type *_actor_stash_slot(actor_state_t *st, long type) {
+  unsigned long h = ((unsigned long)type * 0x9E3779B97F4A7C15UL) >> 32;
+  struct actor_stash_type *t;
+
+  for (h &= st->stash_capacity - 1;; h = (h + 1) & (st->stash_capacity - 1)) {
+    t = &st->stash_types[h];
+    if (!t->used || t->type == type) return t;
+  }
+}
+
+/* rebuilds the table, dropping types with nothing stashed */
+void _actor_stash_resize(actor_state_t *st) {
+  struct actor_stash_type *old = st->stash_types;
+  struct actor_stash_type *t;
+  int old_capacity = st->stash_capacity;
+  int live = 0;
+  int x;
+
+  for (x = 0; x < old_capacity; x++) {
+    if (old[x].head != NULL) live++;
+  }
+  for (st->stash_capacity = ACTOR_STASH_TYPES;
+       st->stash_capacity < live * 4;
+       st->stash_capacity *= 2) {}
+
+  st->stash_types = (struct actor_stash_type*)calloc(
+      st->stash_capacity, sizeof(struct actor_stash_type));
+  assert(st->stash_types != NULL);
+  st->stash_used = 0;
+
+  for (x = 0; x < old_capacity; x++) {
+    if (old[x].head == NULL) continue;
+    t = _actor_stash_slot(st, old[x].type);
+    *t = old[x];
+    st->stash_used++;
+  }
+  free(old);
+}
+
+void _actor_stash_put(actor_state_t *st, actor_msg_t *msg) {
+  actor_block_t *b = ACTOR_BLOCK_HEADER(msg);
+  struct actor_stash_type *t;
+
+  if (st->stash_types == NULL || (st->stash_used + 1) * 2 > st->stash_capacity) {
+    _actor_stash_resize(st);
+  }
+
+  t = _actor_stash_slot(st, msg->type);
+  if (!t->used) {
+    t->used = 1;
+    t->type = msg->type;
+    st->stash_used++;
+  }
+  msg->next = NULL;
+  if (t->tail != NULL) t->tail->next = msg;
+  else t->head = msg;
+  t->tail = msg;
+
+  b->next = NULL;
+  b->prev = (st->stash_last != NULL) ? ACTOR_BLOCK_HEADER(st->stash_last) : NULL;
+  if (b->prev != NULL) b->prev->next = b;
+  else st->stash_first = msg;
+  st->stash_last = msg;
+}
+
+/* removes `msg` from the arrival order list */
+void _actor_stash_unlink(actor_state_t *st, actor_msg_t *msg) {
+  actor_block_t *b = ACTOR_BLOCK_HEADER(msg);
+
+  if (b->prev != NULL) b->prev->next = b->next;
+  else st->stash_first = (b->next != NULL) ? ACTOR_BLOCK_DATA(b->next) : NULL;
+  if (b->next != NULL) b->next->prev = b->prev;
+  else st->stash_last = (b->prev != NULL) ? ACTOR_BLOCK_DATA(b->prev) : NULL;
+  b->next = NULL;
+  b->prev = NULL;
+}
+
+actor_msg_t *_actor_stash_take_type(actor_state_t *st, long type) {
+  struct actor_stash_type *t;
+  actor_msg_t *msg;
+
+  if (st->stash_first == NULL) return NULL;
+  t = _actor_stash_slot(st, type);
+  if ((msg = t->head) == NULL) return NULL;
+
+  if ((t->head = msg->next) == NULL) t->tail = NULL;
+  _actor_stash_unlink(st, msg);
+  return msg;
+}
+
+/* the oldest stashed message is also the oldest of its type */
+actor_msg_t *_actor_stash_take_first(actor_state_t *st) {
+  return _actor_stash_take_type(st, st->stash_first->type);
+}
+
+actor_msg_t *_actor_stash_take_match(
+    actor_state_t *st,
+    actor_match_func_ptr_t match,
+    void *arg) {
+
+  struct actor_stash_type *t;
+  actor_msg_t *msg, *prev;
+  actor_block_t *b;
+
+  if (st->stash_first == NULL) return NULL;
+  for (b = ACTOR_BLOCK_HEADER(st->stash_first); b != NULL; b = b->next) {
+    msg = (actor_msg_t*)ACTOR_BLOCK_DATA(b);
+    if (match(msg, arg)) break;
+  }
+  if (b == NULL) return NULL;
+
+  /* per-type lists are singly linked: find the predecessor */
+  t = _actor_stash_slot(st, msg->type);
+  if (t->head == msg) {
+    prev = NULL;
+    t->head = msg->next;
+  } else {
+    for (prev = t->head; prev->next != msg; prev = prev->next) {}
+    prev->next = msg->next;
+  }
+  if (t->tail == msg) t->tail = prev;
+
+  _actor_stash_unlink(st, msg);
+  return msg;
+}
+
+/* releases whatever is still stashed, once the actor is gone */
+void _actor_stash_destroy(actor_state_t *st) {
+  actor_msg_t *msg;
+
+  while (st->stash_first != NULL) {
+    msg = _actor_stash_take_first(st);
+    _arelease(msg);
+  }
+  free(st->stash_types);
+  st->stash_types = NULL;
+}
+
+
+/*------------------------------------------------------------------------------
+                                     groups
+------------------------------------------------------------------------------*/
+
+/* members are replaced, never modified, so publishers need no lock */
+struct actor_group_members {
+  int count;
+  actor_id ids[1];
+};
+
+struct actor_group {
+  struct actor_group *next;  /* in its bucket, groups are never unlinked */
+  long topic;
+  struct actor_group_members *members;
+};
+
+struct actor_group *_actor_group_find(long topic) {
+  struct actor_group *g = __atomic_load_n(
+      &actor_groups[(unsigned long)topic % ACTOR_GROUP_BUCKETS],
+      __ATOMIC_ACQUIRE);
+
+  for (; g != NULL; g = g->next) {
+    if (g->topic == topic) return g;
+  }
+  return NULL;
+}
+
+/*
+  Builds the group's next member list from the current one: drops `leave`
+  and members that have exited, appends `join`. Called with groups_mutex
+  held.
+*/
+void _actor_group_update(struct actor_group *g, actor_id join, actor_id leave) {
+  struct actor_group_members *old = g->members;
+  struct actor_group_members *m;
+  int count = (old != NULL) ? old->count : 0;
+  int x;
+
+  m = (struct actor_group_members*)malloc(
+      sizeof(struct actor_group_members) + sizeof(actor_id) * count);
+  assert(m != NULL);
+  m->count = 0;
+  for (x = 0; x < count; x++) {
+    if (old->ids[x] == leave || old->ids[x] == join) continue;
+    if (slotmap_get(&actor_registry, old->ids[x]) == NULL) continue;
+    m->ids[m->count++] = old->ids[x];
+  }
+  if (join != ACTOR_INVALID) m->ids[m->count++] = join;
+
+  __atomic_store_n(&g->members, m, __ATOMIC_RELEASE);
+  if (old != NULL) epoch_retire(old, free);
+}
+
+int actor_group_join(long topic) {
+  struct actor_group *g;
+  actor_id myid = _actor_find_by_thread();
+  unsigned long bucket = (unsigned long)topic % ACTOR_GROUP_BUCKETS;
+
+  if (myid == -1) return -1;
+
+  pthread_mutex_lock(&groups_mutex);
+  if ((g = _actor_group_find(topic)) == NULL) {
+    g = (struct actor_group*)malloc(sizeof(struct actor_group));
+    assert(g != NULL);
+    g->topic = topic;
+    g->members = NULL;
+    g->next = actor_groups[bucket];
+    __atomic_store_n(&actor_groups[bucket], g, __ATOMIC_RELEASE);
+  }
+  _actor_group_update(g, myid, ACTOR_INVALID);
+  pthread_mutex_unlock(&groups_mutex);
+
+  return 0;
+}
+
+void actor_group_leave(long topic) {
+  struct actor_group *g;
+  actor_id myid = _actor_find_by_thread();
+
+  if (myid == -1) return;
+
+  pthread_mutex_lock(&groups_mutex);
+  if ((g = _actor_group_find(topic)) != NULL) {
+    _actor_group_update(g, ACTOR_INVALID, myid);
+  }
+  pthread_mutex_unlock(&groups_mutex);
+}
+
+int actor_group_publish(long topic, long type, void *data, size_t size) {
+  struct actor_group *g;
+  struct actor_group_members *m;
+  actor_state_t *st;
+  actor_state_t *self = _actor_current();
+  void *shared;
+  int delivered = 0;
+  int x;
+
+  if (self == NULL || (g = _actor_group_find(topic)) == NULL) return 0;
+
+  shared = _actor_fanout_begin(data, size);
+
+  epoch_enter();
+  m = __atomic_load_n(&g->members, __ATOMIC_ACQUIRE);
+  for (x = 0; m != NULL && x < m->count; x++) {
+    if ((st = slotmap_get(&actor_registry, m->ids[x])) == NULL) continue;
+    delivered += _actor_fanout_send(st, self->myid, type, data, shared, size);
+  }
+  epoch_exit();
+  ACTOR_STAT_ADD(self, stats_sent, delivered);
+
+  arelease(shared);
+  return delivered;
+}
+
+/* called from actor_destroy_all() once nothing can publish any more */
+void _actor_group_destroy_all() {
+  struct actor_group *g, *next;
+  int x;
+
+  for (x = 0; x < ACTOR_GROUP_BUCKETS; x++) {
+    for (g = actor_groups[x]; g != NULL; g = next) {
+      next = g->next;
+      free(g->members);
+      free(g);
+    }
+    actor_groups[x] = NULL;
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                     pools
+------------------------------------------------------------------------------*/
+
+/*
+  A pool is a state of its own in the registry, so its id can be sent to
+  like any other, but it never runs: senders look it up and are routed
+  straight on to one of its members, without an extra hop.
+*/
+
+struct actor_pool_point {
+  unsigned long hash;
+  int member;  /* index into the members' ids */
+};
+
+/* replaced whole on every change and freed through the epoch */
+struct actor_pool_members {
+  int count;
+  struct actor_pool_point *points;  /* sorted; NULL unless hashing */
+  actor_id ids[1];
+};
+
+struct actor_pool {
+  actor_function_ptr_t func;
+  void *args;
+  int strategy;
+  unsigned long next;  /* round-robin cursor */
+  int resizing;  /* resizes under way, which keep the pool alive */
+  pthread_mutex_t resize_mutex;  /* one resize at a time */
+  struct actor_pool_members *members;  /* changed under actors_mutex */
+};
+
+unsigned long _actor_pool_hash(unsigned long x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9UL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBUL;
+  return x ^ (x >> 31);
+}
+
+unsigned long _actor_pool_random() {
+  unsigned long x = pool_random;
+
+  if (x == 0) {
+    x = _actor_pool_hash((unsigned long)&pool_random ^ _actor_now_ns()) | 1;
+  }
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  pool_random = x;
+  return x * 0x2545F4914F6CDD1DUL;
+}
+
+int _actor_pool_point_cmp(const void *a, const void *b) {
+  unsigned long ha = ((const struct actor_pool_point*)a)->hash;
+  unsigned long hb = ((const struct actor_pool_point*)b)->hash;
+  return (ha > hb) - (ha < hb);
+}
+
+/* the member owning the first point at or after the key's hash */
+int _actor_pool_ring_find(struct actor_pool_members *m, unsigned long key) {
+  unsigned long h = _actor_pool_hash(key);
+  int npoints = m->count * ACTOR_POOL_POINTS;
+  int lo = 0;
+  int hi = npoints;
+  int mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (m->points[mid].hash < h) lo = mid + 1;
+    else hi = mid;
+  }
+  return m->points[lo == npoints ? 0 : lo].member;
+}
+
+/*
+  The state a message for `aid` goes to: `aid`'s own, or for a pool the
+  member picked by its strategy. Called inside an epoch section.
+*/
+actor_state_t *_actor_lookup(actor_id aid, unsigned long key) {
+  actor_state_t *st = slotmap_get(&actor_registry, aid);
+  struct actor_pool *p;
+
+  if (st == NULL) return NULL;
+  if ((p = __atomic_load_n(&st->pool, __ATOMIC_ACQUIRE)) == NULL) return st;
+  return _actor_pool_route(p, key);
+}
+
+actor_state_t *_actor_pool_route(struct actor_pool *p, unsigned long key) {
+  struct actor_pool_members *m = __atomic_load_n(&p->members, __ATOMIC_ACQUIRE);
+  actor_state_t *st, *other;
+  unsigned long r;
+  long depth, best;
+  int first = 0;
+  int x;
+
+  if (m == NULL || m->count == 0) return NULL;
+
+  switch (p->strategy) {
+    case ACTOR_POOL_ROUND_ROBIN:
+      first = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED) % m->count;
+      break;
+    case ACTOR_POOL_CONSISTENT_HASH:
+      first = _actor_pool_ring_find(m, key);
+      break;
+    case ACTOR_POOL_LEAST_LOADED:
+      /* start the scan at a rotating member so that ties are spread */
+      first = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED) % m->count;
+      st = NULL;
+      best = 0;
+      for (x = 0; x < m->count; x++) {
+        other = slotmap_get(&actor_registry, m->ids[(first + x) % m->count]);
+        if (other == NULL) continue;
+        depth = __atomic_load_n(&other->mailbox_depth, __ATOMIC_RELAXED);
+        if (st == NULL || depth < best) {
+          st = other;
+          best = depth;
+          if (depth == 0) break;
+        }
+      }
+      return st;
+    case ACTOR_POOL_POWER_OF_TWO:
+      r = _actor_pool_random();
+      first = (int)(r % m->count);
+      x = (int)((r >> 32) % m->count);
+      st = slotmap_get(&actor_registry, m->ids[first]);
+      other = slotmap_get(&actor_registry, m->ids[x]);
+      if (st == NULL) st = other;
+      else if (other != NULL &&
+               __atomic_load_n(&other->mailbox_depth, __ATOMIC_RELAXED) <
+               __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED)) {
+        st = other;
+      }
+      if (st != NULL) return st;
+      break;
+  }
+
+  /* a member that has just exited may still be listed */
+  for (x = 0; x < m->count; x++) {
+    st = slotmap_get(&actor_registry, m->ids[(first + x) % m->count]);
+    if (st != NULL) return st;
+  }
+  return NULL;
+}
+
+/*
+  Makes the live actors among `ids` the pool's members. Called with
+  actors_mutex held, so none of them can exit meanwhile.
+*/
+void _actor_pool_set(struct actor_pool *p, actor_id *ids, int count) {
+  struct actor_pool_members *old = p->members;
+  struct actor_pool_members *m;
+  int hashing = p->strategy == ACTOR_POOL_CONSISTENT_HASH;
+  struct actor_pool_point *pt;
+  unsigned long h;
+  int x, y;
+
+  m = (struct actor_pool_members*)malloc(
+      sizeof(struct actor_pool_members) +
+      sizeof(actor_id) * count +
+      (hashing ? sizeof(struct actor_pool_point) * count * ACTOR_POOL_POINTS
+               : 0));
+  assert(m != NULL);
+  m->count = 0;
+  for (x = 0; x < count; x++) {
+    if (slotmap_get(&actor_registry, ids[x]) == NULL) continue;
+    m->ids[m->count++] = ids[x];
+  }
+
+  /* a member's points depend only on its id, so a resize only moves the
+     keys of the members that join or leave */
+  m->points = NULL;
+  if (hashing) {
+    m->points = (struct actor_pool_point*)&m->ids[count];
+    pt = m->points;
+    for (x = 0; x < m->count; x++) {
+      h = _actor_pool_hash((unsigned long)m->ids[x]);
+      for (y = 0; y < ACTOR_POOL_POINTS; y++, pt++) {
+        pt->hash = _actor_pool_hash(h + y);
+        pt->member = x;
+      }
+    }
+    qsort(m->points, m->count * ACTOR_POOL_POINTS,
+          sizeof(struct actor_pool_point), _actor_pool_point_cmp);
+  }
+
+  __atomic_store_n(&p->members, m, __ATOMIC_RELEASE);
+  if (old != NULL) epoch_retire(old, free);
+}
+
+/*
+  Spawns `count` members and adds them to the pool; returns how many
+  could be spawned. Called with resize_mutex held.
+*/
+int _actor_pool_grow(struct actor_pool *p, actor_id pool, int count) {
+  struct actor_pool_members *m;
+  actor_state_t *st;
+  actor_id *ids;
+  int spawned;
+  int have;
+  int x;
+
+  ids = (actor_id*)malloc(sizeof(actor_id) * count);
+  assert(ids != NULL);
+  for (spawned = 0; spawned < count; spawned++) {
+    ids[spawned] = spawn_actor(p->func, p->args);
+    if (ids[spawned] == ACTOR_INVALID) break;
+  }
+
+  ACCESS_ACTORS_BEGIN;
+  m = p->members;
+  have = (m != NULL) ? m->count : 0;
+  ids = (actor_id*)realloc(ids, sizeof(actor_id) * (have + spawned));
+  assert(have + spawned == 0 || ids != NULL);
+  memmove(ids + have, ids, sizeof(actor_id) * spawned);
+  for (x = 0; x < have; x++) ids[x] = m->ids[x];
+
+  /* members that already exited are left out, and never leave */
+  for (x = have; x < have + spawned; x++) {
+    if ((st = slotmap_get(&actor_registry, ids[x])) != NULL) {
+      st->pool_id = pool;
+    }
+  }
+  _actor_pool_set(p, ids, have + spawned);
+  ACCESS_ACTORS_END;
+
+  free(ids);
+  return spawned;
+}
+
+/*
+  Removes the last `count` members from the pool and tells them to go.
+  Called with resize_mutex held.
+*/
+int _actor_pool_shrink(struct actor_pool *p, actor_id pool, int count) {
+  struct actor_pool_members *m;
+  actor_state_t *st;
+  actor_msg_t *msg;
+  actor_id *ids;
+  int keep;
+  int x;
+
+  ACCESS_ACTORS_BEGIN;
+  m = p->members;
+  keep = m->count > count ? m->count - count : 0;
+  count = m->count - keep;
+  ids = (actor_id*)malloc(sizeof(actor_id) * (m->count + 1));
+  assert(ids != NULL);
+  memcpy(ids, m->ids, sizeof(actor_id) * m->count);
+  for (x = keep; x < keep + count; x++) {
+    if ((st = slotmap_get(&actor_registry, ids[x])) != NULL) {
+      st->pool_id = ACTOR_INVALID;
+    }
+  }
+  _actor_pool_set(p, ids, keep);
+  ACCESS_ACTORS_END;
+
+  /* on the normal lane, behind the messages already routed to them */
+  epoch_enter();
+  for (x = keep; x < keep + count; x++) {
+    if ((st = slotmap_get(&actor_registry, ids[x])) == NULL) continue;
+    msg = _actor_create_msg(ACTOR_MSG_POOL_LEAVE, NULL, 0, pool, ids[x]);
+    /* control messages are not held to the mailbox capacity */
+    __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+    queue_push(&st->messages[ACTOR_PRIO_NORMAL], msg);
+    _actor_notify(st, ACTOR_MSG_POOL_LEAVE);
+  }
+  epoch_exit();
+
+  free(ids);
+  return count;
+}
+
+/* called with actors_mutex held */
+void _actor_pool_retire(actor_state_t *st) {
+  struct actor_pool *p = st->pool;
+
+  if (p->resizing > 0 || (p->members != NULL && p->members->count > 0)) {
+    return;
+  }
+  _actor_destroy_state(st);
+  pthread_cond_signal(&actors_cond);
+}
+
+/* ends a resize, retiring the pool if it was left without members */
+void _actor_pool_release(struct actor_pool *p, actor_id pool) {
+  actor_state_t *st;
+
+  ACCESS_ACTORS_BEGIN;
+  p->resizing--;
+  if ((st = slotmap_get(&actor_registry, pool)) != NULL) _actor_pool_retire(st);
+  ACCESS_ACTORS_END;
+}
+
+/* called with actors_mutex held when a member exits */
+void _actor_pool_leave(actor_state_t *member) {
+  actor_state_t *st = slotmap_get(&actor_registry, member->pool_id);
+  struct actor_pool_members *m;
+  actor_id *ids;
+  int count = 0;
+  int x;
+
+  member->pool_id = ACTOR_INVALID;
+  if (st == NULL || st->pool == NULL) return;
+
+  m = st->pool->members;
+  ids = (actor_id*)malloc(sizeof(actor_id) * (m->count + 1));
+  assert(ids != NULL);
+  for (x = 0; x < m->count; x++) {
+    if (m->ids[x] != member->myid) ids[count++] = m->ids[x];
+  }
+  _actor_pool_set(st->pool, ids, count);
+  free(ids);
+
+  _actor_pool_retire(st);
+}
+
+/* called once no sender can reach the pool any more */
+void _actor_pool_free(struct actor_pool *p) {
+  free(p->members);
+  pthread_mutex_destroy(&p->resize_mutex);
+  free(p);
+}
+
+actor_id spawn_actor_pool(
+    actor_function_ptr_t func,
+    void *args,
+    int n,
+    int strategy) {
+
+  struct actor_pool *p;
+  actor_state_t *st;
+  actor_id aid;
+  int spawned;
+
+  assert(func != NULL);
+  assert(strategy >= ACTOR_POOL_ROUND_ROBIN &&
+         strategy <= ACTOR_POOL_POWER_OF_TWO);
+
+  if (n < 1) {
+    errno = EINVAL;
+    return ACTOR_INVALID;
+  }
+
+  p = (struct actor_pool*)calloc(1, sizeof(struct actor_pool));
+  assert(p != NULL);
+  p->func = func;
+  p->args = args;
+  p->strategy = strategy;
+  p->resizing = 1;
+  pthread_mutex_init(&p->resize_mutex, NULL);
+
+  ACCESS_ACTORS_BEGIN;
+  _actor_init_state(&st);
+  st->parent = _actor_find_by_thread();
+  __atomic_store_n(&st->pool, p, __ATOMIC_RELEASE);
+  aid = st->myid;
+  ACCESS_ACTORS_END;
+
+  pthread_mutex_lock(&p->resize_mutex);
+  spawned = _actor_pool_grow(p, aid, n);
+  pthread_mutex_unlock(&p->resize_mutex);
+  _actor_pool_release(p, aid);
+
+  if (spawned == 0) {  /* the pool is gone with its members */
+    errno = EAGAIN;
+    return ACTOR_INVALID;
+  }
+  return aid;
+}
+
+int actor_pool_resize(actor_id pool, int n) {
+  struct actor_pool *p = NULL;
+  actor_state_t *st;
+  int count;
+  int result = 0;
+
+  if (n < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ACCESS_ACTORS_BEGIN;
+  if ((st = slotmap_get(&actor_registry, pool)) != NULL &&
+      (p = st->pool) != NULL) {
+    p->resizing++;
+  }
+  ACCESS_ACTORS_END;
+
+  if (p == NULL) {
+    errno = ESRCH;
+    return -1;
+  }
+
+  pthread_mutex_lock(&p->resize_mutex);
+  ACCESS_ACTORS_BEGIN;
+  count = (p->members != NULL) ? p->members->count : 0;
+  ACCESS_ACTORS_END;
+  if (n > count && _actor_pool_grow(p, pool, n - count) < n - count) {
+    errno = EAGAIN;
+    result = -1;
+  } else if (n < count) {
+    _actor_pool_shrink(p, pool, count - n);
+  }
+  pthread_mutex_unlock(&p->resize_mutex);
+
+  _actor_pool_release(p, pool);
+  return result;
+}
+
+int actor_pool_size(actor_id pool) {
+  actor_state_t *st;
+  int count = -1;
+
+  ACCESS_ACTORS_BEGIN;
+  if ((st = slotmap_get(&actor_registry, pool)) != NULL && st->pool != NULL) {
+    count = (st->pool->members != NULL) ? st->pool->members->count : 0;
+  }
+  ACCESS_ACTORS_END;
+
+  if (count == -1) errno = ESRCH;
+  return count;
+}
+
+
+/*------------------------------------------------------------------------------
+                                     timers
+------------------------------------------------------------------------------*/
+
+actor_timer_t actor_send_after(
+    actor_id aid,
+    long delay,
+    long type,
+    void *data,
+    size_t size) {
+
+  actor_msg_t *msg;
+  actor_id myid = _actor_find_by_thread();
+  long timer;
+
+  if (myid == -1) return ACTOR_TIMER_INVALID;
+
+  msg = _actor_create_msg(type, data, size, myid, aid);
+  timer = wheel_arm(wheel_deadline(delay), _actor_timer_fire, msg);
+  if (timer == WHEEL_INVALID) {
+    _arelease(msg);
+    return ACTOR_TIMER_INVALID;
+  }
+  return timer;
+}
+
+int actor_cancel_timer(actor_timer_t timer) {
+  return wheel_cancel(timer);
+}
+
+/* satisfies wheel_func_ptr_t; runs on the wheel's thread */
+void _actor_timer_fire(void *arg, int fired) {
+  actor_msg_t *msg = (actor_msg_t*)arg;
+  actor_state_t *st;
+
+  if (fired) {
+    epoch_enter();
+    st = _actor_lookup(msg->dest, (unsigned long)msg->type);
+    if (st != NULL) msg->dest = st->myid;
+    if (st != NULL &&
+        _actor_mailbox_admit(NULL, st, ACTOR_SEND_NOWAIT) == ACTOR_ADMIT_OK) {
+      /* drawn as sent by the actor that called actor_send_after() */
+      TRACE(TRACE_SEND, msg->sender, msg->dest, msg->type, msg->size, 0,
+            (unsigned long)msg);
+      TRACE(TRACE_ENQUEUE, msg->dest, msg->sender, msg->type, msg->size,
+            __atomic_load_n(&st->mailbox_depth, __ATOMIC_RELAXED), 0);
+      queue_push(&st->messages[ACTOR_PRIO_NORMAL], msg);
+      _actor_notify(st, msg->type);
+      msg = NULL;
+    }
+    epoch_exit();
+  }
+
+  if (msg != NULL) _arelease(msg);
+}
+
+
+/*------------------------------------------------------------------------------
+                                       I/O
+------------------------------------------------------------------------------*/
+
+/* most bytes read into one ACTOR_MSG_IO_DATA message */
+#define ACTOR_IO_CHUNK 4096
+
+int actor_watch_fd(int fd, int events) {
+  actor_id myid = _actor_find_by_thread();
+  int flags;
+
+  if (myid == -1) {
+    errno = EPERM;
+    return -1;
+  }
+  if ((flags = fcntl(fd, F_GETFL)) < 0 ||
+      fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return -1;
+  }
+
+  if (events & ACTOR_IO_DATA) events |= ACTOR_IO_READ;
+  if (reactor_add(
+          fd,
+          events & (ACTOR_IO_READ | ACTOR_IO_WRITE),
+          (events & ACTOR_IO_DATA) ? _actor_io_data : _actor_io_ready,
+          (void*)myid) == REACTOR_INVALID) {
+    return -1;
+  }
+  return 0;
+}
+
+int actor_unwatch_fd(int fd) {
+  return reactor_remove(fd);
+}
+
+/*
+  Queues an I/O message for `owner`; 0 if it has exited. Like exit
+  notices these bypass the mailbox capacity: with edge-triggered
+  watches a dropped message would never be sent again, and a dropped
+  completion would leave its buffer in use forever.
+*/
+int _actor_io_send(actor_id owner, long type, void *data, size_t size) {
+  actor_state_t *st;
+  actor_msg_t *msg;
+
+  epoch_enter();
+  st = slotmap_get(&actor_registry, owner);
+  if (st != NULL) {
+    msg = _actor_create_msg(type, data, size, ACTOR_INVALID, owner);
+    __atomic_fetch_add(&st->mailbox_depth, 1, __ATOMIC_RELAXED);
+    queue_push(&st->messages[ACTOR_PRIO_NORMAL], msg);
+    _actor_notify(st, type);
+  }
+  epoch_exit();
+
+  return st != NULL;
+}
+
+/* satisfies reactor_func_ptr_t; runs on the reactor's thread */
+int _actor_io_ready(void *arg, int fd, int events) {
+  actor_io_event_t ev;
+
+  ev.fd = fd;
+  ev.events = events;
+  ev.len = 0;
+  return !_actor_io_send(
+      (actor_id)arg, ACTOR_MSG_IO_READY, &ev, sizeof(ev));
+}
+
+/* reads until the descriptor would block, as the edge demands */
+int _actor_io_data(void *arg, int fd, int events) {
+  union {
+    actor_io_event_t ev;
+    char bytes[sizeof(actor_io_event_t) + ACTOR_IO_CHUNK];
+  } buf;
+  actor_id owner = (actor_id)arg;
+  ssize_t n;
+
+  buf.ev.fd = fd;
+
+  while (events & (ACTOR_IO_READ | ACTOR_IO_HUP)) {
+    n = read(fd, buf.ev.data, ACTOR_IO_CHUNK);
+    if (n > 0) {
+      buf.ev.events = ACTOR_IO_READ;
+      buf.ev.len = n;
+      if (!_actor_io_send(
+              owner, ACTOR_MSG_IO_DATA, &buf.ev, sizeof(buf.ev) + n)) {
+        return 1;
+      }
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      buf.ev.events = ACTOR_IO_HUP;
+      buf.ev.len = 0;
+      _actor_io_send(owner, ACTOR_MSG_IO_CLOSED, &buf.ev, sizeof(buf.ev));
+      return 1;
+    }
+  }
+
+  if (events & ACTOR_IO_WRITE) {
+    buf.ev.events = ACTOR_IO_WRITE;
+    buf.ev.len = 0;
+    if (!_actor_io_send(owner, ACTOR_MSG_IO_READY, &buf.ev, sizeof(buf.ev))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* an asynchronous operation and who started it */
+struct actor_io_op {
+  struct aio_request req;  /* first, so a request converts back */
+  actor_id owner;
+  long tag;
+};
+
+int _actor_io_submit(
+    int op,
+    int fd,
+    int in_fd,
+    void *buf,
+    size_t len,
+    long long off,
+    long tag) {
+
+  int sclass = slab_class(sizeof(struct actor_io_op));
+  actor_id myid = _actor_find_by_thread();
+  struct actor_io_op *o;
+
+  if (myid == -1) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if ((o = (struct actor_io_op*)slab_alloc(sclass)) == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  o->req.op = op;
+  o->req.fd = fd;
+  o->req.in_fd = in_fd;
+  o->req.buf = buf;
+  o->req.len = len;
+  o->req.off = off;
+  o->req.func = _actor_io_done;
+  o->owner = myid;
+  o->tag = tag;
+
+  if (aio_submit(&o->req) != 0) {
+    slab_free(o, sclass);
+    return -1;
+  }
+  return 0;
+}
+
+int actor_set_io_engine(int engine) {
+  return aio_set_engine(engine);
+}
+
+int actor_io_read(int fd, void *buf, size_t len, long long off, long tag) {
+  return _actor_io_submit(ACTOR_IO_OP_READ, fd, -1, buf, len, off, tag);
+}
+
+int actor_io_write(int fd, void *buf, size_t len, long long off, long tag) {
+  return _actor_io_submit(ACTOR_IO_OP_WRITE, fd, -1, buf, len, off, tag);
+}
+
+int actor_io_accept(int fd, long tag) {
+  return _actor_io_submit(ACTOR_IO_OP_ACCEPT, fd, -1, NULL, 0, -1, tag);
+}
+
+int actor_io_sendfile(
+    int out_fd,
+    int in_fd,
+    long long off,
+    size_t len,
+    long tag) {
+
+  return _actor_io_submit(
+      ACTOR_IO_OP_SENDFILE, out_fd, in_fd, NULL, len, off, tag);
+}
+
+int actor_io_register_buffers(void **bufs, size_t *lens, int count) {
+  return aio_register_buffers(bufs, lens, count);
+}
+
+/* satisfies aio_func_ptr_t; runs on an I/O engine thread */
+void _actor_io_done(struct aio_request *req) {
+  struct actor_io_op *o = (struct actor_io_op*)req;
+  actor_io_result_t res;
+
+  res.tag = o->tag;
+  res.op = req->op;
+  res.fd = req->fd;
+  res.buf = req->buf;
+  res.result = req->result;
+  _actor_io_send(o->owner, ACTOR_MSG_IO_DONE, &res, sizeof(res));
+
+  slab_free(o, slab_class(sizeof(struct actor_io_op)));
+}
+
+
+/*------------------------------------------------------------------------------
+                                    tracing
+------------------------------------------------------------------------------*/
+
+void actor_trace_start() {
+  trace_set_enabled(1);
+}
+
+void actor_trace_stop() {
+  trace_set_enabled(0);
+}
+
+int actor_trace_dump(const char *path) {
+  return trace_dump(path);
+}
+
+int actor_trace_dump_on_signal(int signo, const char *path) {
+  return trace_dump_on_signal(signo, path);
+}
+
+
+/*------------------------------------------------------------------------------
+                                memory management
+------------------------------------------------------------------------------*/
+
+void *amalloc(size_t size) {
+  actor_state_t *st = _actor_current();
+
+  if (st != NULL) ACTOR_STAT_ADD(st, stats_alloc_bytes, size);
+  return _amalloc_actor(size, st);
+}
+
+void *_amalloc_actor(size_t size, actor_state_t *owner) {
+  actor_block_t *b;
+  int sclass;
+
+  if (size == 0) return NULL;
+  sclass = slab_class(sizeof(actor_block_t) + size);
+  if (sclass != SLAB_NONE) {
+    b = (actor_block_t*)slab_alloc(sclass);
+  } else {
+    b = (actor_block_t*)malloc(sizeof(actor_block_t) + size);
+  }
+  assert(b != NULL);
+  b->sclass = sclass;
+  b->next = NULL;
+  b->prev = NULL;
+  b->owner = NULL;
+  b->refcount = 1;
+  b->flags = 0;
+
+  if (owner != NULL) _actor_block_adopt(owner, b);
+
+  return ACTOR_BLOCK_DATA(b);
+}
+
+/* links a block into `owner`'s allocs, which must not have been released */
+void _actor_block_adopt(actor_state_t *owner, actor_block_t *b) {
+  pthread_mutex_lock(&owner->alloc_mutex);
+  b->prev = NULL;
+  b->next = owner->allocs;
+  if (b->next != NULL) b->next->prev = b;
+  owner->allocs = b;
+  __atomic_store_n(&b->owner, owner, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&owner->alloc_mutex);
+}
+
+/* unlinks a block from its owner's allocs, if it has an owner */
+void _actor_block_disown(actor_block_t *b) {
+  actor_state_t *owner;
+
+  if (__atomic_load_n(&b->owner, __ATOMIC_ACQUIRE) == NULL) return;
+
+  /* the owner may be exiting on another thread: the epoch keeps its
+     state allocated, and it clears `owner` under alloc_mutex */
+  epoch_enter();
+  owner = __atomic_load_n(&b->owner, __ATOMIC_ACQUIRE);
+  if (owner != NULL) {
+    pthread_mutex_lock(&owner->alloc_mutex);
+    if (b->owner == owner) {
+      if (b->prev != NULL) b->prev->next = b->next;
+      else owner->allocs = b->next;
+      if (b->next != NULL) b->next->prev = b->prev;
+      b->next = NULL;
+      b->prev = NULL;
+      __atomic_store_n(&b->owner, NULL, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&owner->alloc_mutex);
+  }
+  epoch_exit();
+}
+
+/* frees a block after its last reference is gone */
+void _actor_block_free(actor_block_t *b) {
+  actor_msg_t *msg;
+
+  _actor_block_disown(b);
+
+  if (b->flags & ACTOR_BLOCK_MSG) {
+    msg = (actor_msg_t*)ACTOR_BLOCK_DATA(b);
+    if (msg->data != msg->inline_data) _arelease(msg->data);
+  }
+  if (b->sclass != SLAB_NONE) slab_free(b, b->sclass);
+  else free(b);
+}
+
+void arelease(void *block) {
+  ACTOR_THREAD_PRINT("arelease()");
+  _arelease(block);
+}
+
+void _arelease(void *block) {
+  actor_block_t *b;
+
+  if (block == NULL) return;
+  b = ACTOR_BLOCK_HEADER(block);
+
+  if (__atomic_sub_fetch(&b->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+    _actor_block_free(b);
+  }
+}
+
+void arelease_many(void **blocks, int count) {
+  actor_state_t *self = _actor_current();
+  actor_block_t *b, *next;
+  actor_block_t *dead;
+  unsigned long mine;
+  int base, n, x;
+
+  for (base = 0; base < count; base += 64) {
+    n = (count - base < 64) ? count - base : 64;
+
+    /* blocks owned by someone else, or by nobody, take the usual path;
+       no other thread can make a block ours */
+    mine = 0;
+    for (x = 0; x < n; x++) {
+      if (blocks[base + x] == NULL) continue;
+      b = ACTOR_BLOCK_HEADER(blocks[base + x]);
+      if (self != NULL && __atomic_load_n(&b->owner, __ATOMIC_ACQUIRE) == self) {
+        mine |= 1UL << x;
+      } else {
+        _arelease(blocks[base + x]);
+      }
+    }
+    if (mine == 0) continue;
+
+    /* the rest are released with one acquisition of our alloc_mutex */
+    dead = NULL;
+    pthread_mutex_lock(&self->alloc_mutex);
+    for (x = 0; x < n; x++) {
+      if ((mine & (1UL << x)) == 0) continue;
+      b = ACTOR_BLOCK_HEADER(blocks[base + x]);
+      if (__atomic_sub_fetch(&b->refcount, 1, __ATOMIC_ACQ_REL) != 0) continue;
+      if (b->prev != NULL) b->prev->next = b->next;
+      else self->allocs = b->next;
+      if (b->next != NULL) b->next->prev = b->prev;
+      b->prev = NULL;
+      __atomic_store_n(&b->owner, NULL, __ATOMIC_RELEASE);
+      b->next = dead;
+      dead = b;
+    }
+    pthread_mutex_unlock(&self->alloc_mutex);
+
+    for (b = dead; b != NULL; b = next) {
+      next = b->next;
+      b->next = NULL;
+      _actor_block_free(b);
+    }
+  }
+}
+
+void aretain(void *block) {
+  if (block == NULL) return;
+  __atomic_add_fetch(&ACTOR_BLOCK_HEADER(block)->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void _actor_release_memory(actor_state_t *state) {
+  actor_block_t *b, *next;
+  actor_block_t *dead = NULL;
+  int count = 0;
+
+  /* drop the owner's reference to each block while holding alloc_mutex,
+     so a concurrent _actor_block_free() cannot unlink one under us */
+  pthread_mutex_lock(&state->alloc_mutex);
+  for (b = state->allocs; b != NULL; b = next) {
+    next = b->next;
+    b->next = NULL;
+    b->prev = NULL;
+    __atomic_store_n(&b->owner, NULL, __ATOMIC_RELEASE);
+    if (__atomic_sub_fetch(&b->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+      b->next = dead;
+      dead = b;
+    }
+    count++;
+  }
+  state->allocs = NULL;
+  pthread_mutex_unlock(&state->alloc_mutex);
+
+#ifdef DEBUG_MEMORY
+  if (count > 0) {
+    printf(
+        "_actor_release_memory(): "
+        "automatically released %d allocations. "
+        "(actor_id = %d)\n",
+        count,
+        (int)state->myid);
   }
 #endif
-  for (info = (struct actor_alloc*)state->allocs; info != NULL;) {
-    tmp = info->next;
-    _arelease(info->block, pthread_self());
-    info = tmp;
+  (void)count;
+
+  /* freeing a message releases its data, which may take other locks */
+  for (b = dead; b != NULL; b = next) {
+    next = b->next;
+    b->next = NULL;
+    _actor_block_free(b);
   }
 }
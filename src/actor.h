@@ -32,6 +32,7 @@
 #include <assert.h>
 
 #include "./list.h"
+#include "./queue.h"
 
 
 /*------------------------------------------------------------------------------
@@ -48,19 +49,41 @@
 #define ACCESS_ACTORS_END pthread_mutex_unlock(&actors_mutex)
 
 #define ACTOR_INVALID -1
+#define ACTOR_TIMER_INVALID -1
+
+/* actor_spawn_opts_t.guard_pages for a thread stack without a guard */
+#define ACTOR_NO_GUARD -1
+
+/* payloads up to this size are stored inside the actor_msg_t itself */
+#define ACTOR_MSG_INLINE_SIZE 64
+
+/* mailbox lanes; receives drain higher lanes first */
+enum {
+  ACTOR_PRIO_LOW = 0,
+  ACTOR_PRIO_NORMAL,
+  ACTOR_PRIO_HIGH,
+  ACTOR_PRIO_LANES
+};
+
+/* what a send does when the receiver's mailbox is at capacity */
+enum {
+  ACTOR_MAILBOX_BLOCK = 0,   /* wait until the receiver makes room */
+  ACTOR_MAILBOX_FAIL,        /* reject the message */
+  ACTOR_MAILBOX_DROP_OLDEST, /* discard the oldest queued message */
+  ACTOR_MAILBOX_DROP_NEWEST  /* discard the message being sent */
+};
+
+#if defined(_MSC_VER)
+#  define ACTOR_TLS __declspec(thread)
+#else
+#  define ACTOR_TLS __thread
+#endif  // defined(_MSC_VER)
 
 
 /*------------------------------------------------------------------------------
                                     types
 ------------------------------------------------------------------------------*/
 
-struct alloc_info_struct {
-  struct alloc_info_struct *next;
-  void *block;
-  unsigned int refcount;
-};
-typedef struct alloc_info_struct alloc_info_t;
-
 /*
 **
 ** Actor Function
@@ -87,6 +110,21 @@ typedef long actor_id;
 struct actor_message_struct;
 typedef struct actor_message_struct actor_msg_t;
 
+/**
+ * Refers to a pending delayed message, see actor_send_after().
+ */
+typedef long actor_timer_t;
+
+/**
+ * A predicate for actor_receive_match_fn(): nonzero if `msg` is wanted.
+ */
+typedef int (*actor_match_func_ptr_t)(actor_msg_t *msg, void *arg);
+
+/**
+ * A handler actor's function: called with the actor's state and a message.
+ */
+typedef void (*actor_handler_ptr_t)(void *, actor_msg_t *);
+
 /**
  * This structure contains information about a message.
  */
@@ -117,25 +155,239 @@ struct actor_message_struct {
    * The size of the data.
    */
   size_t size;
+
+  /**
+   * Holds the data of small messages; `data` then points here. Starts at
+   * a 16-byte aligned offset, like a block from amalloc().
+   */
+  char inline_data[ACTOR_MSG_INLINE_SIZE];
 };
 
-struct actor_alloc {
-  struct actor_alloc *next;
-  void *block;
+/**
+ * One message of a batch passed to actor_send_batch().
+ */
+struct actor_send_entry_struct {
+  actor_id dest;
+  long type;
+  void *data;
+  size_t size;
 };
+typedef struct actor_send_entry_struct actor_send_entry_t;
+
+/**
+ * Options for spawn_actor_ex(). A zero-filled structure gives the same
+ * actor as spawn_actor().
+ */
+struct actor_spawn_opts_struct {
+  /**
+   * The most messages the mailbox holds, or 0 for no limit.
+   */
+  long mailbox_capacity;
+
+  /**
+   * What sends to a full mailbox do, e.g. `ACTOR_MAILBOX_BLOCK`.
+   */
+  int mailbox_policy;
+
+  /**
+   * The thread's stack size in bytes, or 0 for the system default
+   * (usually 8 MB of address space). Fibers always get
+   * `ACTOR_FIBER_STACK_SIZE`.
+   */
+  size_t stack_size;
+
+  /**
+   * Guard pages below the thread's stack, 0 for the system default or
+   * `ACTOR_NO_GUARD` for none.
+   */
+  int guard_pages;
+
+  /**
+   * Where the actor runs, e.g. `ACTOR_PLACE_NODE`; see spawn_actor_ex().
+   */
+  int placement;
+
+  /**
+   * The CPU for `ACTOR_PLACE_CPU`.
+   */
+  int cpu;
+
+  /**
+   * The NUMA node for `ACTOR_PLACE_NODE`.
+   */
+  int node;
+
+  /**
+   * The actor to run next to for `ACTOR_PLACE_NEAR`.
+   */
+  actor_id near;
+};
+typedef struct actor_spawn_opts_struct actor_spawn_opts_t;
+
+/**
+ * A snapshot of an actor's mailbox, filled by actor_mailbox_stats().
+ */
+struct actor_mailbox_stats_struct {
+  long depth;     /* messages waiting to be received */
+  long capacity;  /* 0 if unbounded */
+  long dropped;   /* messages discarded because the mailbox was full */
+};
+typedef struct actor_mailbox_stats_struct actor_mailbox_stats_t;
+
+/**
+ * An actor's runtime counters, filled by actor_stats() and
+ * actor_stats_snapshot(). All counts are since the actor was spawned.
+ */
+struct actor_stats_struct {
+  actor_id id;
+  long sent;                /* messages queued for other actors */
+  long received;            /* messages taken from the mailbox */
+  long mailbox_depth;       /* messages waiting to be received */
+  long mailbox_capacity;    /* 0 if unbounded */
+  long mailbox_high_water;  /* the most messages ever waiting at once */
+  long mailbox_dropped;     /* discarded because the mailbox was full */
+  long alloc_bytes;         /* requested through amalloc() */
+  long long wait_ns;        /* blocked in a receive */
+  long long busy_ns;        /* spent running */
+};
+typedef struct actor_stats_struct actor_stats_t;
+
+/**
+ * The payload of the `ACTOR_MSG_IO_` messages sent for a descriptor
+ * watched with actor_watch_fd().
+ */
+struct actor_io_event_struct {
+  int fd;
+  int events;  /* the `ACTOR_IO_` bits that are ready */
+  size_t len;  /* bytes in `data`, only for `ACTOR_MSG_IO_DATA` */
+  char data[];
+};
+typedef struct actor_io_event_struct actor_io_event_t;
+
+/**
+ * The payload of the `ACTOR_MSG_IO_DONE` message sent when an operation
+ * started with actor_io_read() or one of its siblings completes.
+ */
+struct actor_io_result_struct {
+  long tag;     /* as passed when the operation was started */
+  int op;       /* `ACTOR_IO_OP_READ`, `ACTOR_IO_OP_WRITE`, ... */
+  int fd;
+  void *buf;    /* the buffer of a read or write */
+  long result;  /* bytes moved or the accepted descriptor; -errno on failure */
+};
+typedef struct actor_io_result_struct actor_io_result_t;
+
+struct sched_fiber;
+struct actor_stash_type;
+struct actor_pool;
+
+/*
+  Prefixed to every block handed out by amalloc(). Its size is a multiple
+  of 16, so the block itself keeps malloc()'s alignment.
+*/
+struct actor_block_struct {
+  struct actor_block_struct *next;  /* in the owner's allocs */
+  struct actor_block_struct *prev;
+  actor_state_t *owner;  /* NULL while in flight or once the owner exited */
+  int refcount;
+  short flags;
+  short sclass;  /* slab size class, or SLAB_NONE if malloc()ed */
+};
+typedef struct actor_block_struct actor_block_t;
 
 struct actor_state_struct {
-  actor_state_t *next;
   actor_id myid;
-  actor_msg_t *messages;
+  queue_t messages[ACTOR_PRIO_LANES];  /* one mailbox lane per priority */
+  int sleeping;  /* set while the actor waits on msg_cond */
   pthread_t thread;
+  struct sched_fiber *fiber;  /* NULL unless the actor runs as a fiber */
+  actor_handler_ptr_t handler;  /* NULL unless spawned as a handler */
+  void *handler_state;
+  int scheduled;  /* handler is queued on or running on a worker */
+  int exiting;
+  actor_state_t *sched_next;
   pthread_cond_t msg_cond;
   pthread_mutex_t msg_mutex;
-  list_item_t *allocs;
+  actor_block_t *allocs;  /* released when the actor exits */
+  pthread_mutex_t alloc_mutex;
+  actor_msg_t *stash_first;  /* set aside by actor_receive_match() */
+  actor_msg_t *stash_last;
+  struct actor_stash_type *stash_types;
+  int stash_capacity;
+  int stash_used;
+  long match_type;  /* the type a matching receive waits for */
+  int match_wait;
+  actor_id parent;  /* the actor that spawned this one, if any */
+  int trap_exit;
+  long mailbox_capacity;  /* 0 if unbounded */
+  int mailbox_policy;
+  long mailbox_depth;  /* messages in the lanes, stash not included */
+  long mailbox_dropped;
+  int mailbox_waiters;  /* senders blocked until the mailbox has room */
+  pthread_mutex_t shed_mutex;  /* lets ACTOR_MAILBOX_DROP_OLDEST senders pop */
+  int timer_fired;  /* a receive timeout's timer woke the actor */
+  long mailbox_high_water;  /* as of the last receive, see actor_stats() */
+  long stats_sent;
+  long stats_received;
+  long stats_alloc_bytes;  /* requested through amalloc() */
+  long long stats_wait_ns;  /* blocked in a receive */
+  long long stats_busy_ns;  /* running messages, handler actors only */
+  long long stats_wait_since;  /* start of the current wait, 0 if none */
+  long long stats_started_ns;
+  struct actor_pool *pool;  /* set if the id routes to a pool's members */
+  actor_id pool_id;  /* the pool this actor serves in, if any */
+  int cpu;   /* the CPU the actor is pinned to, or -1 */
+  int node;  /* the NUMA node the actor is pinned to, or -1 */
+};
+
+enum {
+  ACTOR_MSG_EXITED = 1,
+  ACTOR_MSG_IO_READY,
+  ACTOR_MSG_IO_DATA,
+  ACTOR_MSG_IO_CLOSED,
+  ACTOR_MSG_IO_DONE,
+  ACTOR_MSG_POOL_LEAVE
+};
+
+enum {
+  ACTOR_IO_READ = 1,
+  ACTOR_IO_WRITE = 2,
+  ACTOR_IO_HUP = 4,
+  ACTOR_IO_DATA = 8
+};
+
+enum {
+  ACTOR_IO_OP_READ = 1,
+  ACTOR_IO_OP_WRITE,
+  ACTOR_IO_OP_ACCEPT,
+  ACTOR_IO_OP_SENDFILE
+};
+
+enum {
+  ACTOR_IO_ENGINE_AUTO = 0,
+  ACTOR_IO_ENGINE_URING,
+  ACTOR_IO_ENGINE_THREADS
+};
+
+/* where spawn_actor_ex() runs an actor, see actor_spawn_opts_t */
+enum {
+  ACTOR_PLACE_ANY = 0,  /* wherever the kernel likes */
+  ACTOR_PLACE_CPU,      /* on opts->cpu */
+  ACTOR_PLACE_NODE,     /* on the CPUs of NUMA node opts->node */
+  ACTOR_PLACE_NEAR      /* on the NUMA node of actor opts->near */
+};
+
+/* how spawn_actor_pool() picks the member a message goes to */
+enum {
+  ACTOR_POOL_ROUND_ROBIN = 0,
+  ACTOR_POOL_LEAST_LOADED,     /* the shortest mailbox */
+  ACTOR_POOL_CONSISTENT_HASH,  /* the member owning the message's key */
+  ACTOR_POOL_POWER_OF_TWO      /* the shorter of two random mailboxes */
 };
 
 enum {
-  ACTOR_MSG_EXITED = 1
+  ACTOR_SCHED_THREADS = 0,
+  ACTOR_SCHED_FIBERS
 };
 
 
@@ -149,6 +401,22 @@ enum {
 void actor_init();
 
 
+/**
+ * Choose how actors spawned from now on are run.
+ *
+ * `ACTOR_SCHED_THREADS` (the default) gives every actor its own pthread.
+ * `ACTOR_SCHED_FIBERS` runs actors as user-space fibers with small pooled
+ * stacks, multiplexed over a fixed pool of worker threads; receiving on an
+ * empty mailbox yields the worker to another actor instead of blocking it.
+ * Fibers should avoid blocking system calls, which stall their worker.
+ *
+ * @param mode     `ACTOR_SCHED_THREADS` or `ACTOR_SCHED_FIBERS`
+ * @param workers  worker threads for fiber mode, 0 for one per CPU
+ * @return         0 on success, -1 if the workers could not be started
+ */
+int actor_set_scheduler(int mode, int workers);
+
+
 /**
  * Spawn a new actor.
  * 
@@ -159,6 +427,146 @@ void actor_init();
 actor_id spawn_actor(actor_function_ptr_t func, void *args);
 
 
+/**
+ * Same as spawn_actor(), with options.
+ *
+ * A bounded mailbox holds at most `opts->mailbox_capacity` messages and
+ * applies `opts->mailbox_policy` to sends that find it full:
+ *
+ * - `ACTOR_MAILBOX_BLOCK` makes the sender wait for room. Fibers yield
+ *   while they wait. Handler actors and actors sending to themselves
+ *   cannot wait, so their messages are queued past the capacity.
+ * - `ACTOR_MAILBOX_FAIL` rejects the message; actor_try_send() reports
+ *   this, other sends discard it.
+ * - `ACTOR_MAILBOX_DROP_OLDEST` discards the oldest queued message, taken
+ *   from the lowest priority lane, to make room.
+ * - `ACTOR_MAILBOX_DROP_NEWEST` discards the message being sent.
+ *
+ * Broadcasts and group messages never wait: they treat a full
+ * `ACTOR_MAILBOX_BLOCK` mailbox like `ACTOR_MAILBOX_FAIL`.
+ *
+ * In thread mode, an actor runs on a parked thread left by one that
+ * exited with the same `opts->stack_size` and `opts->guard_pages`, and
+ * only gets a new thread if there is none. A thread keeps its signal mask
+ * and thread-local variables from one actor to the next.
+ *
+ * `opts->placement` pins a thread-mode actor's thread to one CPU or to the
+ * CPUs of one NUMA node, and has its memory, including the messages and
+ * amalloc() blocks it allocates, come from that node. `ACTOR_PLACE_NEAR`
+ * puts the actor on the node `opts->near` is pinned to, or if it is not
+ * pinned, on the node the caller is running on; an actor spawning a
+ * helper it talks to a lot can pass its own id. Fibers are not pinned.
+ *
+ * @param func  the function that the thread should run
+ * @param args  passed to the actor when it is spawned
+ * @param opts  the options, or NULL for the defaults
+ * @return      the `actor_id`, or `ACTOR_INVALID` on failure, with errno
+ *              set to `EINVAL` for a CPU or node that does not exist or
+ *              that the process is not allowed to run on
+ */
+actor_id spawn_actor_ex(
+    actor_function_ptr_t func,
+    void *args,
+    const actor_spawn_opts_t *opts);
+
+/**
+ * Node ids need not be contiguous: an id below this may belong to an
+ * offline node, which `ACTOR_PLACE_NODE` refuses.
+ *
+ * @return  one more than the highest NUMA node id, 1 on machines without
+ *          NUMA
+ */
+int actor_numa_nodes();
+
+
+/**
+ * Spawn a run-to-completion actor.
+ *
+ * Instead of a thread or fiber looping on actor_receive(), `handler` is
+ * called once per message by the scheduler's work-stealing worker pool,
+ * which is started on first use. The message is released when the handler
+ * returns. A handler actor has no stack of its own and must not call
+ * actor_receive(); it handles at most `ACTOR_HANDLER_BATCH` messages in a
+ * row before other actors get a turn.
+ *
+ * @param handler  called as `handler(state, msg)` for every message
+ * @param state    passed to every call of `handler`
+ * @return         the `actor_id`, or `ACTOR_INVALID` on failure
+ */
+actor_id spawn_actor_handler(actor_handler_ptr_t handler, void *state);
+
+
+/**
+ * Spawn `n` actors running `func(args)` behind a single `actor_id`.
+ *
+ * Each message sent to the pool's id goes straight to one member, picked
+ * by `strategy`:
+ *
+ * - `ACTOR_POOL_ROUND_ROBIN` takes the members in turn.
+ * - `ACTOR_POOL_LEAST_LOADED` takes the member with the fewest messages
+ *   waiting, looking at every member's mailbox.
+ * - `ACTOR_POOL_CONSISTENT_HASH` maps the message's key, as given to
+ *   actor_send_keyed() or else its type, to a member on a hash ring, so
+ *   messages with the same key go to the same member and resizing the
+ *   pool moves few keys.
+ * - `ACTOR_POOL_POWER_OF_TWO` compares the mailboxes of two random
+ *   members and takes the shorter.
+ *
+ * Each entry of a batch from actor_send_batch() is routed on its own,
+ * keyed by its type; entries that reach the same member keep their order.
+ * Members that exit leave the pool; the pool's id stays live until the
+ * last member is gone.
+ *
+ * @param func      the function that each member runs
+ * @param args      passed to every member
+ * @param n         the number of members, at least 1
+ * @param strategy  one of the `ACTOR_POOL_` strategies
+ * @return          the pool's `actor_id`, or `ACTOR_INVALID` on failure
+ */
+actor_id spawn_actor_pool(
+    actor_function_ptr_t func,
+    void *args,
+    int n,
+    int strategy);
+
+
+/**
+ * Grow or shrink a pool to `n` members. New members run the pool's
+ * function; members that are removed no longer get new messages and are
+ * sent `ACTOR_MSG_POOL_LEAVE`, which arrives after the messages already
+ * routed to them, and should exit once they receive it. Shrinking to 0
+ * retires the pool's id.
+ *
+ * @return  0, or -1 with `errno` set to `ESRCH` if `pool` is not a live
+ *          pool, `EINVAL` if `n` is negative, or `EAGAIN` if members
+ *          could not be spawned
+ */
+int actor_pool_resize(actor_id pool, int n);
+
+
+/**
+ * The number of members a pool currently routes to, or -1 with `errno`
+ * set to `ESRCH` if `pool` is not a live pool.
+ */
+int actor_pool_size(actor_id pool);
+
+
+/**
+ * Ask to be told when actors spawned by the calling actor exit. Each exit
+ * then sends the parent an `ACTOR_MSG_EXITED` message from the dead
+ * actor's id, on the high priority lane.
+ *
+ * @param trap  nonzero to enable, 0 to disable
+ */
+void actor_trap_exit(int trap);
+
+
+/**
+ * Stop the calling handler actor once its current message is handled.
+ */
+void actor_exit();
+
+
 /**
  * Destroy all actors
  */
@@ -183,12 +591,330 @@ void actor_wait_finish();
 void actor_send_msg(actor_id aid, long type, void * data, size_t size);
 
 
+/**
+ * Same as actor_send_msg(), but never waits for room in a bounded mailbox.
+ *
+ * @return  0 if the message was queued, or dropped under
+ *          `ACTOR_MAILBOX_DROP_NEWEST`; otherwise -1 with `errno` set to
+ *          `EAGAIN` if the mailbox is full, `ESRCH` if `aid` is not a live
+ *          actor, or `EPERM` if the caller is not an actor
+ */
+int actor_try_send(actor_id aid, long type, void *data, size_t size);
+
+
+/**
+ * Same as actor_send_msg(), but a `ACTOR_POOL_CONSISTENT_HASH` pool
+ * routes the message by `key` rather than by its type. Other actors and
+ * pools ignore the key.
+ */
+void actor_send_keyed(
+    actor_id aid,
+    unsigned long key,
+    long type,
+    void *data,
+    size_t size);
+
+
+/**
+ * Read the depth, capacity and drop count of an actor's mailbox.
+ *
+ * The depth does not include messages set aside by actor_receive_match().
+ *
+ * @param aid    the actor to inspect
+ * @param stats  filled in on success
+ * @return       0, or -1 with `errno` set to `ESRCH` if `aid` is not live
+ */
+int actor_mailbox_stats(actor_id aid, actor_mailbox_stats_t *stats);
+
+
+/**
+ * Read an actor's runtime counters.
+ *
+ * The counters are kept by the actor itself and read without stopping it,
+ * so they may be a few messages apart from each other. A thread or fiber
+ * actor counts as busy whenever it is not waiting in a receive; a handler
+ * actor only while it runs messages. Messages sent by the timer thread for
+ * actor_send_after(), exit notices and I/O messages are not counted as
+ * sent by anyone.
+ *
+ * The counters are not kept if the library was built with
+ * `ACTOR_NO_STATS`; they then read as 0.
+ *
+ * @param aid    the actor to inspect
+ * @param stats  filled in on success
+ * @return       0, or -1 with `errno` set to `ESRCH` if `aid` is not live
+ */
+int actor_stats(actor_id aid, actor_stats_t *stats);
+
+
+/**
+ * Read the runtime counters of every live actor, as actor_stats() does.
+ * Actors may be spawned or exit during the walk; those may or may not be
+ * included.
+ *
+ * @param stats  room for `max` entries
+ * @param max    the most entries to fill in
+ * @return       the number of live actors found, which may be more than
+ *               `max`; only the first `max` of them are filled in
+ */
+int actor_stats_snapshot(actor_stats_t *stats, int max);
+
+
+/**
+ * Start recording spawn, exit, send, enqueue, dequeue and block/unblock
+ * events. Each thread records into its own ring of recent events, without
+ * locks; while tracing is off a tracepoint costs one branch.
+ */
+void actor_trace_start();
+
+
+/**
+ * Stop recording events. Those recorded so far are kept for
+ * actor_trace_dump().
+ */
+void actor_trace_stop();
+
+
+/**
+ * Write the recorded events to `path` in the Chrome trace event JSON
+ * format, which chrome://tracing and the Perfetto UI open. Each actor is
+ * drawn as a thread, with arrows from each send to the matching receive
+ * and a counter for its mailbox depth. Safe to call while actors run and
+ * record.
+ *
+ * @return  0, or -1 with `errno` set if the file could not be written
+ */
+int actor_trace_dump(const char *path);
+
+
+/**
+ * Dump the recorded events to `path`, as actor_trace_dump() does, each
+ * time the process receives `signo`, e.g. `SIGUSR1`. The dump is written
+ * by a background thread, not in the signal handler. Calling this again
+ * only changes the path.
+ *
+ * @return  0, or -1 with `errno` set
+ */
+int actor_trace_dump_on_signal(int signo, const char *path);
+
+
+/**
+ * Same as actor_send_msg(), but on the mailbox lane for `prio`. Receives
+ * take messages from higher lanes first, so a high priority message does
+ * not wait behind a backlog of normal ones; within a lane order is FIFO.
+ *
+ * @param prio  `ACTOR_PRIO_LOW`, `ACTOR_PRIO_NORMAL` or `ACTOR_PRIO_HIGH`
+ */
+void actor_send_msg_prio(
+    actor_id aid,
+    long type,
+    void *data,
+    size_t size,
+    int prio);
+
+
+/**
+ * Send several messages at once.
+ *
+ * The data of each entry is copied as by actor_send_msg(). Messages to the
+ * same actor are appended to its mailbox in entry order with a single
+ * atomic operation, and each receiver is woken once for the whole batch.
+ *
+ * @param entries  the messages to send
+ * @param count    the number of entries
+ * @return         the number of messages delivered to live actors
+ */
+int actor_send_batch(actor_send_entry_t *entries, int count);
+
+
+/**
+ * Send a block to an actor without copying it.
+ *
+ * The message takes over one of the caller's references to `block`, which
+ * the receiver drops when it releases the message. The caller must not
+ * touch the block afterwards unless it kept another reference with
+ * aretain(), e.g. to send the same immutable block to several actors, and
+ * the block is no longer released automatically when the caller exits.
+ *
+ * @param aid    the Actor to which the message is sent
+ * @param type   a user defined value
+ * @param block  a block from amalloc(), or NULL
+ * @param size   the size of the data in `block`
+ */
+void actor_send_owned(actor_id aid, long type, void *block, size_t size);
+
+
+/**
+ * Send a message to an actor after `delay` milliseconds.
+ *
+ * The data is copied now. Delays are measured on CLOCK_MONOTONIC by a
+ * library-wide timer wheel, on which arming and cancelling cost O(1)
+ * however many timers are pending. When the timer fires the message is
+ * queued like a broadcast: it never waits for room in a bounded mailbox.
+ * Timers have millisecond resolution; messages due on the same tick may
+ * arrive in any order.
+ *
+ * @param aid    the Actor to which the message is sent
+ * @param delay  milliseconds from now
+ * @param type   a user defined value
+ * @param data   a pointer to a block of data that will be sent to the Actor
+ * @param size   the size of the data pointed at by `data`
+ * @return       a timer for actor_cancel_timer(), or `ACTOR_TIMER_INVALID`
+ */
+actor_timer_t actor_send_after(
+    actor_id aid,
+    long delay,
+    long type,
+    void *data,
+    size_t size);
+
+
+/**
+ * Cancel a message scheduled with actor_send_after().
+ *
+ * @return  0 if the message will not be sent, -1 if it was already sent
+ *          or `timer` is not valid
+ */
+int actor_cancel_timer(actor_timer_t timer);
+
+
+/**
+ * Watch a descriptor on the library's epoll thread, sending the calling
+ * actor a message each time it becomes ready. One actor can watch any
+ * number of descriptors this way instead of blocking a thread on each.
+ *
+ * The descriptor is made non-blocking and watched edge-triggered: an
+ * `ACTOR_MSG_IO_READY` message says which of `ACTOR_IO_READ`,
+ * `ACTOR_IO_WRITE` and `ACTOR_IO_HUP` became ready, and no more are sent
+ * for a direction until the actor has read or written until EAGAIN.
+ *
+ * With `ACTOR_IO_DATA` the library reads instead, sending what arrives
+ * as `ACTOR_MSG_IO_DATA` messages of at most a few kilobytes each, then
+ * a single `ACTOR_MSG_IO_CLOSED` at end of file or on an error, after
+ * which the descriptor is no longer watched.
+ *
+ * I/O messages are not held to the mailbox capacity. Watching a
+ * descriptor again replaces the previous watch, whichever actor set it;
+ * the watch of an actor that has exited ends at its next event.
+ *
+ * @param fd      a socket, pipe or other descriptor epoll supports
+ * @param events  `ACTOR_IO_READ`, `ACTOR_IO_WRITE` and/or `ACTOR_IO_DATA`
+ * @return        0 on success, -1 with errno set on failure
+ */
+int actor_watch_fd(int fd, int events);
+
+
+/**
+ * Stop watching a descriptor. No message for it is queued after this
+ * returns, so it is then safe to close it; messages already queued are
+ * still received.
+ *
+ * @return  0 if the descriptor was watched, -1 otherwise
+ */
+int actor_unwatch_fd(int fd);
+
+
+/**
+ * Choose how actor_io_read() and its siblings are carried out, before the
+ * first of them is called. `ACTOR_IO_ENGINE_URING` submits them to an
+ * io_uring; `ACTOR_IO_ENGINE_THREADS` hands them to a pool of threads
+ * making blocking calls. `ACTOR_IO_ENGINE_AUTO`, the default, uses
+ * io_uring when both the build and the kernel support it.
+ *
+ * @return  0 on success, -1 if the engine is unavailable or another one
+ *          is already in use
+ */
+int actor_set_io_engine(int engine);
+
+
+/**
+ * Start reading from a descriptor without blocking the calling actor.
+ * When the read completes, the actor receives an `ACTOR_MSG_IO_DONE`
+ * message whose actor_io_result_t holds `tag` and the number of bytes
+ * read. `buf` is filled in place, so it must stay valid until then.
+ *
+ * Like the other asynchronous operations, completions are not held to
+ * the mailbox capacity.
+ *
+ * @param fd   a file, socket or pipe
+ * @param buf  where the data goes
+ * @param len  the most bytes to read
+ * @param off  the file offset to read at, or -1 for the current position
+ * @param tag  a user defined value identifying the operation
+ * @return     0 if the read was started, -1 with errno set otherwise
+ */
+int actor_io_read(int fd, void *buf, size_t len, long long off, long tag);
+
+
+/**
+ * Start writing to a descriptor, like actor_io_read(). `buf` is not
+ * copied and must stay valid until the completion is received.
+ */
+int actor_io_write(int fd, void *buf, size_t len, long long off, long tag);
+
+
+/**
+ * Start accepting a connection on a listening socket. The completion's
+ * `result` is the new descriptor.
+ */
+int actor_io_accept(int fd, long tag);
+
+
+/**
+ * Start copying `len` bytes from `in_fd`, at `off` or its current
+ * position if `off` is -1, to the socket `out_fd` without passing them
+ * through user memory. This always runs on the thread pool, since
+ * io_uring has no single operation for it.
+ */
+int actor_io_sendfile(
+    int out_fd,
+    int in_fd,
+    long long off,
+    size_t len,
+    long tag);
+
+
+/**
+ * Register buffers with the I/O engine, replacing those registered
+ * before; `count` 0 drops them. With io_uring, reads and writes that lie
+ * within a registered buffer use pages the kernel has pinned once,
+ * instead of mapping them for every operation. Operations using the
+ * previous buffers must have completed.
+ *
+ * @return  0 on success, -1 with errno set otherwise
+ */
+int actor_io_register_buffers(void **bufs, size_t *lens, int count);
+
+
 /**
  * Broadcast a message to all actors.
  */
 void actor_broadcast_msg(long type, void * data, size_t size);
 
 
+/**
+ * Subscribe the calling actor to a publish/subscribe group. Groups are
+ * created on first join; an actor that exits leaves its groups.
+ *
+ * @param topic  a user defined value naming the group
+ * @return       0 on success, -1 if not called from an actor
+ */
+int actor_group_join(long topic);
+
+/**
+ * Unsubscribe the calling actor from a group.
+ */
+void actor_group_leave(long topic);
+
+/**
+ * Send a message to every member of a group. The data is copied once and
+ * shared by all members' messages, so treat it as read-only.
+ *
+ * @return  the number of members the message was delivered to
+ */
+int actor_group_publish(long topic, long type, void *data, size_t size);
+
+
 /**
  * Reply to a received message.
  */
@@ -206,6 +932,38 @@ actor_msg_t * actor_receive();
 actor_msg_t * actor_receive_timeout(long timeout);
 
 
+/**
+ * Selective receive: take the oldest message of `type`, waiting up to
+ * `timeout` milliseconds (0 waits forever). Other messages keep their
+ * place in the mailbox for later receives; they are indexed by type, so
+ * finding a stashed reply is O(1), and they do not wake the waiting actor.
+ *
+ * @return  the message, or NULL on timeout
+ */
+actor_msg_t *actor_receive_match(long type, long timeout);
+
+/**
+ * Same as actor_receive_match(), but takes the oldest message for which
+ * `match(msg, arg)` returns nonzero. Every new message wakes the actor.
+ */
+actor_msg_t *actor_receive_match_fn(
+    actor_match_func_ptr_t match,
+    void *arg,
+    long timeout);
+
+
+/**
+ * Receive a batch of messages: waits like actor_receive_timeout() for the
+ * first one, then takes whatever else is already queued, up to `max`.
+ *
+ * @param msgs     filled with the received messages
+ * @param max      the capacity of `msgs`
+ * @param timeout  in milliseconds, 0 to wait forever
+ * @return         the number of messages received, 0 on timeout
+ */
+int actor_receive_many(actor_msg_t **msgs, int max, long timeout);
+
+
 /**
  * Gets the actor_id of the executing Actor.
  *
@@ -214,8 +972,41 @@ actor_msg_t * actor_receive_timeout(long timeout);
 actor_id actor_self();
 
 /* Memory management */
+
+/**
+ * Allocate a reference-counted block owned by the calling actor. Blocks
+ * still held when their owner exits are released automatically.
+ *
+ * @param size  the size of the block
+ * @return      the block, or NULL if `size` is 0
+ */
 void *amalloc(size_t size);
+
+/**
+ * Drop a reference to a block; the block is freed when the last one goes.
+ * Releasing a message also releases its data.
+ *
+ * @param block  a block from amalloc() or a received message, may be NULL
+ */
 void arelease(void *block);
 
+/**
+ * arelease() every non-NULL entry of `blocks`, e.g. the messages from
+ * actor_receive_many().
+ *
+ * @param blocks  the blocks to release
+ * @param count   the number of entries
+ */
+void arelease_many(void **blocks, int count);
+
+/**
+ * Take an extra reference to a block. To keep a message's data after
+ * releasing the message, retain the message itself: small payloads live
+ * inside it.
+ *
+ * @param block  a block from amalloc() or a received message
+ */
+void aretain(void *block);
+
 
 #endif  // SRC_ACTOR_H_
@@ -0,0 +1,604 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#  include <sys/sendfile.h>
+#endif  // defined(__linux__)
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+
+#include "./aio.h"
+
+#define AIO_POOL_THREADS 8
+
+/* how often a pool thread waiting on a descriptor checks for aio_stop() */
+#define AIO_POLL_MS 100
+
+static pthread_mutex_t aio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int aio_chosen = AIO_ENGINE_AUTO;
+static int aio_running = AIO_ENGINE_AUTO;  /* the engine once started */
+static int aio_stopping = 0;
+
+static pthread_mutex_t aio_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aio_pool_cond = PTHREAD_COND_INITIALIZER;
+static struct aio_request *aio_pool_head = NULL;
+static struct aio_request *aio_pool_tail = NULL;
+static pthread_t aio_pool_threads[AIO_POOL_THREADS];
+static int aio_pool_nthreads = 0;
+
+
+/*------------------------------------------------------------------------------
+                                  thread pool
+------------------------------------------------------------------------------*/
+
+/* 0 once `req` can be tried without blocking for long, -1 on aio_stop() */
+static int aio_pool_wait(struct aio_request *req) {
+  struct pollfd p;
+
+  p.fd = req->fd;
+  p.events = (req->op == AIO_READ || req->op == AIO_ACCEPT) ? POLLIN : POLLOUT;
+  while (!__atomic_load_n(&aio_stopping, __ATOMIC_ACQUIRE)) {
+    if (poll(&p, 1, AIO_POLL_MS) != 0) return 0;
+  }
+  return -1;
+}
+
+static long aio_pool_call(struct aio_request *req) {
+  ssize_t n;
+#if defined(__linux__)
+  off_t off = req->off;
+#endif  // defined(__linux__)
+
+  switch (req->op) {
+    case AIO_READ:
+      n = req->off < 0 ? read(req->fd, req->buf, req->len)
+                       : pread(req->fd, req->buf, req->len, req->off);
+      break;
+    case AIO_WRITE:
+      n = req->off < 0 ? write(req->fd, req->buf, req->len)
+                       : pwrite(req->fd, req->buf, req->len, req->off);
+      break;
+    case AIO_ACCEPT:
+      n = accept(req->fd, NULL, NULL);
+      break;
+#if defined(__linux__)
+    case AIO_SENDFILE:
+      n = sendfile(req->fd, req->in_fd, req->off < 0 ? NULL : &off, req->len);
+      break;
+#endif  // defined(__linux__)
+    default:
+      errno = ENOSYS;
+      n = -1;
+  }
+  return n < 0 ? -errno : (long)n;
+}
+
+static void aio_pool_run(struct aio_request *req) {
+  for (;;) {
+    if (aio_pool_wait(req) != 0) {
+      req->result = -ECANCELED;
+      break;
+    }
+    /* the descriptor may be non-blocking, and readiness can be spurious */
+    req->result = aio_pool_call(req);
+    if (req->result != -EAGAIN && req->result != -EWOULDBLOCK &&
+        req->result != -EINTR) {
+      break;
+    }
+  }
+  req->func(req);
+}
+
+static void *aio_pool_main(void *arg) {
+  struct aio_request *req;
+
+  pthread_mutex_lock(&aio_pool_mutex);
+  for (;;) {
+    while (aio_pool_head == NULL && !aio_stopping) {
+      pthread_cond_wait(&aio_pool_cond, &aio_pool_mutex);
+    }
+    if ((req = aio_pool_head) == NULL) break;
+    aio_pool_head = req->next;
+    if (aio_pool_head == NULL) aio_pool_tail = NULL;
+    pthread_mutex_unlock(&aio_pool_mutex);
+
+    aio_pool_run(req);
+
+    pthread_mutex_lock(&aio_pool_mutex);
+  }
+  pthread_mutex_unlock(&aio_pool_mutex);
+
+  return NULL;
+}
+
+static int aio_pool_submit(struct aio_request *req) {
+  pthread_mutex_lock(&aio_pool_mutex);
+
+  if (aio_stopping) {
+    pthread_mutex_unlock(&aio_pool_mutex);
+    errno = ECANCELED;
+    return -1;
+  }
+  for (; aio_pool_nthreads < AIO_POOL_THREADS; aio_pool_nthreads++) {
+    if (pthread_create(
+            &aio_pool_threads[aio_pool_nthreads], NULL,
+            aio_pool_main, NULL) != 0) {
+      break;
+    }
+  }
+  if (aio_pool_nthreads == 0) {
+    pthread_mutex_unlock(&aio_pool_mutex);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  req->next = NULL;
+  if (aio_pool_tail == NULL) aio_pool_head = req;
+  else aio_pool_tail->next = req;
+  aio_pool_tail = req;
+  pthread_cond_signal(&aio_pool_cond);
+
+  pthread_mutex_unlock(&aio_pool_mutex);
+  return 0;
+}
+
+/* called once aio_stopping is set; queued requests complete cancelled */
+static void aio_pool_stop() {
+  int x;
+
+  pthread_mutex_lock(&aio_pool_mutex);
+  pthread_cond_broadcast(&aio_pool_cond);
+  pthread_mutex_unlock(&aio_pool_mutex);
+
+  for (x = 0; x < aio_pool_nthreads; x++) {
+    pthread_join(aio_pool_threads[x], NULL);
+  }
+  aio_pool_nthreads = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+                                    io_uring
+------------------------------------------------------------------------------*/
+
+#if defined(HAVE_LINUX_IO_URING_H)
+
+#define AIO_URING_ENTRIES 256
+
+/* user_data of the request aio_stop() cancels everything with */
+#define AIO_URING_CANCEL 0
+
+static int aio_ring_fd = -1;
+static void *aio_sq_ring;
+static void *aio_cq_ring;
+static size_t aio_sq_ring_size;
+static size_t aio_cq_ring_size;
+static unsigned *aio_sq_tail;
+static unsigned *aio_sq_mask;
+static unsigned *aio_sq_array;
+static unsigned *aio_cq_head;
+static unsigned *aio_cq_tail;
+static unsigned *aio_cq_mask;
+static struct io_uring_sqe *aio_sqes;
+static size_t aio_sqes_size;
+static struct io_uring_cqe *aio_cqes;
+static pthread_t aio_uring_thread;
+
+/* serializes submissions and buffer registration */
+static pthread_mutex_t aio_sq_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* requests in the ring that have not completed yet */
+static long aio_inflight = 0;
+
+static void **aio_bufs = NULL;
+static size_t *aio_buf_lens = NULL;
+static int aio_nbufs = 0;
+
+
+static int aio_uring_enter(unsigned submit, unsigned wait, unsigned flags) {
+  return (int)syscall(
+      __NR_io_uring_enter, aio_ring_fd, submit, wait, flags, NULL, 0);
+}
+
+static void aio_uring_unmap() {
+  if (aio_sqes != NULL && aio_sqes != MAP_FAILED) {
+    munmap(aio_sqes, aio_sqes_size);
+  }
+  if (aio_cq_ring != NULL && aio_cq_ring != MAP_FAILED &&
+      aio_cq_ring != aio_sq_ring) {
+    munmap(aio_cq_ring, aio_cq_ring_size);
+  }
+  if (aio_sq_ring != NULL && aio_sq_ring != MAP_FAILED) {
+    munmap(aio_sq_ring, aio_sq_ring_size);
+  }
+  aio_sqes = NULL;
+  aio_sq_ring = aio_cq_ring = NULL;
+  close(aio_ring_fd);
+  aio_ring_fd = -1;
+}
+
+static int aio_uring_setup() {
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  aio_ring_fd = (int)syscall(__NR_io_uring_setup, AIO_URING_ENTRIES, &p);
+  if (aio_ring_fd < 0) return -1;
+
+  aio_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  aio_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (aio_cq_ring_size > aio_sq_ring_size) {
+      aio_sq_ring_size = aio_cq_ring_size;
+    }
+  }
+
+  aio_sq_ring = mmap(
+      NULL, aio_sq_ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_SQ_RING);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    aio_cq_ring = aio_sq_ring;
+  } else {
+    aio_cq_ring = mmap(
+        NULL, aio_cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_CQ_RING);
+  }
+  aio_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  aio_sqes = mmap(
+      NULL, aio_sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_SQES);
+  if (aio_sq_ring == MAP_FAILED || aio_cq_ring == MAP_FAILED ||
+      aio_sqes == MAP_FAILED) {
+    aio_uring_unmap();
+    return -1;
+  }
+
+  aio_sq_tail = (unsigned*)((char*)aio_sq_ring + p.sq_off.tail);
+  aio_sq_mask = (unsigned*)((char*)aio_sq_ring + p.sq_off.ring_mask);
+  aio_sq_array = (unsigned*)((char*)aio_sq_ring + p.sq_off.array);
+  aio_cq_head = (unsigned*)((char*)aio_cq_ring + p.cq_off.head);
+  aio_cq_tail = (unsigned*)((char*)aio_cq_ring + p.cq_off.tail);
+  aio_cq_mask = (unsigned*)((char*)aio_cq_ring + p.cq_off.ring_mask);
+  aio_cqes = (struct io_uring_cqe*)((char*)aio_cq_ring + p.cq_off.cqes);
+  return 0;
+}
+
+/*
+  Called with aio_sq_mutex held. Every entry is submitted right away, so
+  the kernel has consumed the ring by the time this returns and it never
+  fills up.
+*/
+static int aio_uring_push(const struct io_uring_sqe *sqe) {
+  unsigned tail = *aio_sq_tail;
+  unsigned index = tail & *aio_sq_mask;
+  int ret;
+
+  aio_sqes[index] = *sqe;
+  aio_sq_array[index] = index;
+  __atomic_store_n(aio_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  for (;;) {
+    ret = aio_uring_enter(1, 0, 0);
+    if (ret == 1) return 0;
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      __atomic_store_n(aio_sq_tail, tail, __ATOMIC_RELEASE);
+      return -1;
+    }
+    /* out of memory for the request, or completions must be reaped */
+    sched_yield();
+  }
+}
+
+/* the registered buffer holding all of `req`'s, or -1 */
+static int aio_uring_buffer(struct aio_request *req) {
+  char *buf = (char*)req->buf;
+  int x;
+
+  for (x = 0; x < aio_nbufs; x++) {
+    if (buf >= (char*)aio_bufs[x] &&
+        buf + req->len <= (char*)aio_bufs[x] + aio_buf_lens[x]) {
+      return x;
+    }
+  }
+  return -1;
+}
+
+static int aio_uring_submit(struct aio_request *req) {
+  struct io_uring_sqe sqe;
+  int index;
+
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.fd = req->fd;
+  sqe.user_data = (uint64_t)(uintptr_t)req;
+
+  pthread_mutex_lock(&aio_sq_mutex);
+
+  if (aio_stopping) {
+    pthread_mutex_unlock(&aio_sq_mutex);
+    errno = ECANCELED;
+    return -1;
+  }
+
+  switch (req->op) {
+    case AIO_READ:
+    case AIO_WRITE:
+      sqe.addr = (uint64_t)(uintptr_t)req->buf;
+      sqe.len = req->len > UINT32_MAX ? UINT32_MAX : (uint32_t)req->len;
+      sqe.off = req->off < 0 ? (uint64_t)-1 : (uint64_t)req->off;
+      if ((index = aio_uring_buffer(req)) >= 0) {
+        sqe.opcode = req->op == AIO_READ ? IORING_OP_READ_FIXED
+                                         : IORING_OP_WRITE_FIXED;
+        sqe.buf_index = index;
+      } else {
+        sqe.opcode = req->op == AIO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+      }
+      break;
+    case AIO_ACCEPT:
+      sqe.opcode = IORING_OP_ACCEPT;
+      break;
+  }
+
+  __atomic_fetch_add(&aio_inflight, 1, __ATOMIC_RELEASE);
+  if (aio_uring_push(&sqe) != 0) {
+    __atomic_fetch_sub(&aio_inflight, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&aio_sq_mutex);
+    return -1;
+  }
+
+  pthread_mutex_unlock(&aio_sq_mutex);
+  return 0;
+}
+
+/* the only consumer of the completion ring */
+static void *aio_uring_main(void *arg) {
+  struct io_uring_cqe cqe;
+  struct aio_request *req;
+  unsigned head;
+
+  for (;;) {
+    head = __atomic_load_n(aio_cq_head, __ATOMIC_RELAXED);
+    if (head == __atomic_load_n(aio_cq_tail, __ATOMIC_ACQUIRE)) {
+      if (__atomic_load_n(&aio_stopping, __ATOMIC_ACQUIRE) &&
+          __atomic_load_n(&aio_inflight, __ATOMIC_RELAXED) == 0) {
+        break;
+      }
+      aio_uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+
+    cqe = aio_cqes[head & *aio_cq_mask];
+    __atomic_store_n(aio_cq_head, head + 1, __ATOMIC_RELEASE);
+    if (cqe.user_data == AIO_URING_CANCEL) continue;
+
+    /* pairs with the submitter's increment, which the request's fields
+       come before; the kernel orders them too, out of the compiler's view */
+    __atomic_fetch_sub(&aio_inflight, 1, __ATOMIC_ACQ_REL);
+    req = (struct aio_request*)(uintptr_t)cqe.user_data;
+    req->result = cqe.res;
+    req->func(req);
+  }
+
+  return NULL;
+}
+
+/* called with aio_mutex held */
+static int aio_uring_start() {
+  if (aio_uring_setup() != 0) return -1;
+  if (pthread_create(&aio_uring_thread, NULL, aio_uring_main, NULL) != 0) {
+    aio_uring_unmap();
+    return -1;
+  }
+  return 0;
+}
+
+/* called once aio_stopping is set */
+static void aio_uring_stop() {
+  struct io_uring_sqe sqe;
+
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_ASYNC_CANCEL;
+  sqe.fd = -1;
+  sqe.cancel_flags = IORING_ASYNC_CANCEL_ANY;
+  sqe.user_data = AIO_URING_CANCEL;
+
+  /* its completion also wakes the thread if nothing was in flight */
+  pthread_mutex_lock(&aio_sq_mutex);
+  aio_uring_push(&sqe);
+  pthread_mutex_unlock(&aio_sq_mutex);
+
+  pthread_join(aio_uring_thread, NULL);
+
+  aio_uring_unmap();
+  free(aio_bufs);
+  free(aio_buf_lens);
+  aio_bufs = NULL;
+  aio_buf_lens = NULL;
+  aio_nbufs = 0;
+}
+
+static int aio_uring_register(void **bufs, size_t *lens, int count) {
+  struct iovec *iov = NULL;
+  void **new_bufs = NULL;
+  size_t *new_lens = NULL;
+  int x;
+
+  if (count > 0) {
+    iov = (struct iovec*)malloc(sizeof(struct iovec) * count);
+    new_bufs = (void**)malloc(sizeof(void*) * count);
+    new_lens = (size_t*)malloc(sizeof(size_t) * count);
+    if (iov == NULL || new_bufs == NULL || new_lens == NULL) {
+      free(iov);
+      free(new_bufs);
+      free(new_lens);
+      errno = ENOMEM;
+      return -1;
+    }
+    for (x = 0; x < count; x++) {
+      iov[x].iov_base = new_bufs[x] = bufs[x];
+      iov[x].iov_len = new_lens[x] = lens[x];
+    }
+  }
+
+  pthread_mutex_lock(&aio_sq_mutex);
+  if (aio_nbufs > 0) {
+    syscall(__NR_io_uring_register, aio_ring_fd,
+            IORING_UNREGISTER_BUFFERS, NULL, 0);
+  }
+  free(aio_bufs);
+  free(aio_buf_lens);
+  aio_bufs = NULL;
+  aio_buf_lens = NULL;
+  aio_nbufs = 0;
+
+  if (count > 0 &&
+      syscall(__NR_io_uring_register, aio_ring_fd,
+              IORING_REGISTER_BUFFERS, iov, count) != 0) {
+    pthread_mutex_unlock(&aio_sq_mutex);
+    free(iov);
+    free(new_bufs);
+    free(new_lens);
+    return -1;
+  }
+  aio_bufs = new_bufs;
+  aio_buf_lens = new_lens;
+  aio_nbufs = count;
+  pthread_mutex_unlock(&aio_sq_mutex);
+
+  free(iov);
+  return 0;
+}
+
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+
+
+/*------------------------------------------------------------------------------
+                                    engines
+------------------------------------------------------------------------------*/
+
+int aio_set_engine(int engine) {
+  pthread_mutex_lock(&aio_mutex);
+  if (aio_running != AIO_ENGINE_AUTO) {
+    pthread_mutex_unlock(&aio_mutex);
+    return engine == aio_running ? 0 : -1;
+  }
+  aio_chosen = engine;
+  pthread_mutex_unlock(&aio_mutex);
+
+  if (aio_engine() == -1) {
+    pthread_mutex_lock(&aio_mutex);
+    aio_chosen = AIO_ENGINE_AUTO;
+    pthread_mutex_unlock(&aio_mutex);
+    return -1;
+  }
+  return 0;
+}
+
+int aio_engine() {
+  int engine = __atomic_load_n(&aio_running, __ATOMIC_ACQUIRE);
+
+  if (engine != AIO_ENGINE_AUTO) return engine;
+
+  pthread_mutex_lock(&aio_mutex);
+  if (aio_running == AIO_ENGINE_AUTO) {
+#if defined(HAVE_LINUX_IO_URING_H)
+    if (aio_chosen != AIO_ENGINE_THREADS && aio_uring_start() == 0) {
+      __atomic_store_n(&aio_running, AIO_ENGINE_URING, __ATOMIC_RELEASE);
+    }
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+    if (aio_running == AIO_ENGINE_AUTO && aio_chosen != AIO_ENGINE_URING) {
+      __atomic_store_n(&aio_running, AIO_ENGINE_THREADS, __ATOMIC_RELEASE);
+    }
+  }
+  engine = aio_running == AIO_ENGINE_AUTO ? -1 : aio_running;
+  pthread_mutex_unlock(&aio_mutex);
+
+  return engine;
+}
+
+int aio_submit(struct aio_request *req) {
+  int engine = aio_engine();
+
+  if (engine == -1) {
+    errno = ENOSYS;
+    return -1;
+  }
+#if defined(HAVE_LINUX_IO_URING_H)
+  if (engine == AIO_ENGINE_URING && req->op != AIO_SENDFILE) {
+    return aio_uring_submit(req);
+  }
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+  return aio_pool_submit(req);
+}
+
+int aio_register_buffers(void **bufs, size_t *lens, int count) {
+#if defined(HAVE_LINUX_IO_URING_H)
+  if (aio_engine() == AIO_ENGINE_URING) {
+    return aio_uring_register(bufs, lens, count);
+  }
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+  /* pool threads read straight into the caller's memory anyway */
+  return 0;
+}
+
+void aio_stop() {
+  int engine;
+
+  pthread_mutex_lock(&aio_mutex);
+  engine = aio_running;
+  if (engine == AIO_ENGINE_AUTO) {
+    pthread_mutex_unlock(&aio_mutex);
+    return;
+  }
+
+  /* under both locks, so that no submission slips past the cancel */
+  pthread_mutex_lock(&aio_pool_mutex);
+#if defined(HAVE_LINUX_IO_URING_H)
+  pthread_mutex_lock(&aio_sq_mutex);
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+  __atomic_store_n(&aio_stopping, 1, __ATOMIC_RELEASE);
+#if defined(HAVE_LINUX_IO_URING_H)
+  pthread_mutex_unlock(&aio_sq_mutex);
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+  pthread_mutex_unlock(&aio_pool_mutex);
+
+#if defined(HAVE_LINUX_IO_URING_H)
+  if (engine == AIO_ENGINE_URING) aio_uring_stop();
+#endif  // defined(HAVE_LINUX_IO_URING_H)
+  aio_pool_stop();
+
+  __atomic_store_n(&aio_running, AIO_ENGINE_AUTO, __ATOMIC_RELEASE);
+  aio_chosen = AIO_ENGINE_AUTO;
+  aio_stopping = 0;
+  pthread_mutex_unlock(&aio_mutex);
+}
@@ -0,0 +1,89 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_AIO_H_
+#define SRC_AIO_H_
+
+#include <stddef.h>
+
+/*
+  Asynchronous reads, writes, accepts and sendfile() transfers. Requests
+  are handed to one of two engines, chosen when the first one is
+  submitted:
+
+  - io_uring, driven through the raw system calls: submitters fill the
+    submission ring under a lock and a completion thread reaps the
+    completion ring. Reads and writes that fall inside a buffer passed
+    to aio_register_buffers() use the fixed-buffer opcodes, so the
+    kernel does not map the pages for every request.
+  - a pool of threads making the blocking calls, where io_uring is not
+    built in or the kernel refuses it. Pool threads poll() before each
+    call so that aio_stop() is never held up by an idle descriptor.
+
+  io_uring has no sendfile(), so those always go to the pool.
+
+  Either way a request's function is called once, from an engine thread,
+  with `result` set; the request may be freed from there.
+*/
+
+/* the same values as ACTOR_IO_ENGINE_AUTO and friends */
+#define AIO_ENGINE_AUTO    0
+#define AIO_ENGINE_URING   1
+#define AIO_ENGINE_THREADS 2
+
+/* the same values as ACTOR_IO_OP_READ and friends */
+#define AIO_READ     1
+#define AIO_WRITE    2
+#define AIO_ACCEPT   3
+#define AIO_SENDFILE 4
+
+struct aio_request;
+typedef void (*aio_func_ptr_t)(struct aio_request *req);
+
+struct aio_request {
+  struct aio_request *next;  /* in the pool's queue */
+  int op;
+  int fd;
+  int in_fd;      /* the source of an AIO_SENDFILE */
+  void *buf;
+  size_t len;
+  long long off;  /* -1 for the descriptor's current position */
+  long result;    /* bytes transferred or a descriptor, -errno on failure */
+  aio_func_ptr_t func;
+};
+
+/* picks the engine; -1 once one is running or if it is unavailable */
+int aio_set_engine(int engine);
+
+/* the engine in use, starting one if needed; -1 if none could start */
+int aio_engine();
+
+/* 0 once `req` is queued, -1 with errno set otherwise */
+int aio_submit(struct aio_request *req);
+
+/*
+  Replaces the set of registered buffers; `count` 0 drops them. Requests
+  using the previous set must have completed.
+*/
+int aio_register_buffers(void **bufs, size_t *lens, int count);
+
+/* cancels what is in flight, completing it with -ECANCELED, then joins */
+void aio_stop();
+
+#endif  // SRC_AIO_H_
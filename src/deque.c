@@ -0,0 +1,97 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stddef.h>
+
+#include "./deque.h"
+
+/* memory orderings follow Lê, Pop, Cohen and Zappa Nardelli (PPoPP '13) */
+
+#define DEQUE_SLOT(d, i) (&(d)->items[(i) & (DEQUE_CAPACITY - 1)])
+
+void deque_init(deque_t *d) {
+  d->top = 0;
+  d->bottom = 0;
+}
+
+/* owner only; returns -1 if the deque is full */
+int deque_push(deque_t *d, void *x) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  if (b - t >= DEQUE_CAPACITY) return -1;
+
+  __atomic_store_n(DEQUE_SLOT(d, b), x, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/* owner only; returns NULL if the deque is empty */
+void *deque_take(deque_t *d) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  long t;
+  void *x = NULL;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+  if (t <= b) {
+    x = __atomic_load_n(DEQUE_SLOT(d, b), __ATOMIC_RELAXED);
+    if (t == b) {  /* last item: race the thieves for it */
+      if (!__atomic_compare_exchange_n(
+              &d->top, &t, t + 1, 0,
+              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        x = NULL;
+      }
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return x;
+}
+
+/* any thread; returns NULL if empty or DEQUE_ABORT on a lost race */
+void *deque_steal(deque_t *d) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  long b;
+  void *x;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+  if (t >= b) return NULL;
+
+  x = __atomic_load_n(DEQUE_SLOT(d, t), __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(
+          &d->top, &t, t + 1, 0,
+          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return DEQUE_ABORT;
+  }
+  return x;
+}
+
+/* a hint only when called by a thief */
+int deque_empty(deque_t *d) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+  return t >= b;
+}
@@ -0,0 +1,50 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_DEQUE_H_
+#define SRC_DEQUE_H_
+
+/*
+  Fixed-capacity Chase-Lev work-stealing deque. The owning thread pushes
+  and takes at the bottom; any other thread may steal from the top.
+  deque_push() fails instead of growing when the deque is full.
+*/
+
+#define DEQUE_CAPACITY 4096  /* must be a power of two */
+
+#define DEQUE_ABORT ((void *)-1)  /* deque_steal() lost a race, try again */
+
+struct deque_struct {
+  long top;
+  char pad[64 - sizeof(long)];
+  long bottom;
+  void *items[DEQUE_CAPACITY];
+};
+typedef struct deque_struct deque_t;
+
+
+void deque_init(deque_t *d);
+
+int deque_push(deque_t *d, void *x);
+void *deque_take(deque_t *d);
+void *deque_steal(deque_t *d);
+
+int deque_empty(deque_t *d);
+
+#endif  // SRC_DEQUE_H_
@@ -0,0 +1,175 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "./epoch.h"
+
+#if defined(_MSC_VER)
+#  define EPOCH_TLS __declspec(thread)
+#else
+#  define EPOCH_TLS __thread
+#endif  // defined(_MSC_VER)
+
+/*
+  Three limbo lists are enough: an object retired in epoch `e` can be
+  freed once the global epoch reaches `e + 2`, because every reader that
+  was active in `e` must have left before the epoch could move twice.
+*/
+#define EPOCH_LIMBO_LISTS 3
+
+/* one per thread that has ever entered a critical section; never freed */
+struct epoch_record {
+  struct epoch_record *next;
+  unsigned long state;  /* (epoch << 1) | 1 while inside, 0 outside */
+  int nesting;
+  int in_use;
+};
+
+struct epoch_garbage {
+  struct epoch_garbage *next;
+  void *item;
+  epoch_free_func_ptr_t func;
+};
+
+static pthread_mutex_t epoch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t epoch_key;
+static unsigned long epoch_global = 0;
+static struct epoch_record *epoch_records = NULL;
+static struct epoch_garbage *epoch_limbo[EPOCH_LIMBO_LISTS];
+
+static EPOCH_TLS struct epoch_record *epoch_self = NULL;
+
+
+static void epoch_thread_exit(void *arg) {
+  struct epoch_record *r = (struct epoch_record*)arg;
+  assert(r->nesting == 0);
+  __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_key_init() {
+  pthread_key_create(&epoch_key, epoch_thread_exit);
+}
+
+static struct epoch_record *epoch_register() {
+  struct epoch_record *r;
+
+  pthread_once(&epoch_once, epoch_key_init);
+  pthread_mutex_lock(&epoch_mutex);
+
+  for (r = epoch_records; r != NULL; r = r->next) {
+    if (__atomic_load_n(&r->in_use, __ATOMIC_ACQUIRE) == 0) break;
+  }
+  if (r == NULL) {
+    r = (struct epoch_record*)calloc(1, sizeof(struct epoch_record));
+    assert(r != NULL);
+    r->next = epoch_records;
+    __atomic_store_n(&epoch_records, r, __ATOMIC_RELEASE);
+  }
+  r->in_use = 1;
+
+  pthread_mutex_unlock(&epoch_mutex);
+
+  pthread_setspecific(epoch_key, r);
+  epoch_self = r;
+  return r;
+}
+
+void epoch_enter() {
+  struct epoch_record *r = epoch_self;
+  unsigned long e;
+
+  if (r == NULL) r = epoch_register();
+  if (r->nesting++ > 0) return;
+
+  e = __atomic_load_n(&epoch_global, __ATOMIC_RELAXED);
+  __atomic_store_n(&r->state, (e << 1) | 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit() {
+  struct epoch_record *r = epoch_self;
+
+  assert(r != NULL && r->nesting > 0);
+  if (--r->nesting > 0) return;
+
+  __atomic_store_n(&r->state, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_free_list(struct epoch_garbage *g) {
+  struct epoch_garbage *next;
+  for (; g != NULL; g = next) {
+    next = g->next;
+    g->func(g->item);
+    free(g);
+  }
+}
+
+/* called with epoch_mutex held */
+static int epoch_try_advance() {
+  struct epoch_record *r;
+  struct epoch_garbage *ready;
+  unsigned long e = __atomic_load_n(&epoch_global, __ATOMIC_RELAXED);
+  unsigned long s;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (r = epoch_records; r != NULL; r = r->next) {
+    s = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+    if ((s & 1) && (s >> 1) != e) return 0;
+  }
+
+  __atomic_store_n(&epoch_global, e + 1, __ATOMIC_SEQ_CST);
+
+  /* everything retired in e - 1 is now unreachable */
+  ready = epoch_limbo[(e + 2) % EPOCH_LIMBO_LISTS];
+  epoch_limbo[(e + 2) % EPOCH_LIMBO_LISTS] = NULL;
+  epoch_free_list(ready);
+  return 1;
+}
+
+void epoch_retire(void *item, epoch_free_func_ptr_t func) {
+  struct epoch_garbage *g;
+  unsigned long e;
+
+  g = (struct epoch_garbage*)malloc(sizeof(struct epoch_garbage));
+  assert(g != NULL);
+  g->item = item;
+  g->func = func;
+
+  pthread_mutex_lock(&epoch_mutex);
+  e = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+  g->next = epoch_limbo[e % EPOCH_LIMBO_LISTS];
+  epoch_limbo[e % EPOCH_LIMBO_LISTS] = g;
+
+  if (epoch_try_advance()) epoch_try_advance();
+  pthread_mutex_unlock(&epoch_mutex);
+}
+
+void epoch_drain() {
+  int x;
+  pthread_mutex_lock(&epoch_mutex);
+  for (x = 0; x < EPOCH_LIMBO_LISTS; x++) {
+    epoch_free_list(epoch_limbo[x]);
+    epoch_limbo[x] = NULL;
+  }
+  pthread_mutex_unlock(&epoch_mutex);
+}
@@ -0,0 +1,46 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_EPOCH_H_
+#define SRC_EPOCH_H_
+
+/*
+  Epoch-based reclamation.
+
+  Readers bracket their accesses to shared objects with epoch_enter() and
+  epoch_exit(); these only touch thread-local state and never block.
+  Writers unlink an object so that new readers cannot find it and then
+  hand it to epoch_retire(), which calls `func` once every reader that
+  might still hold a reference has left its critical section.
+
+  Critical sections may nest but must not block for long: a thread that
+  stays inside one holds back all reclamation.
+*/
+
+typedef void (*epoch_free_func_ptr_t)(void *);
+
+void epoch_enter();
+void epoch_exit();
+
+void epoch_retire(void *item, epoch_free_func_ptr_t func);
+
+/* frees everything retired so far; only safe once no readers remain */
+void epoch_drain();
+
+#endif  // SRC_EPOCH_H_
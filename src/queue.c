@@ -0,0 +1,88 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "./queue.h"
+
+void queue_init(queue_t *q) {
+  q->stub.next = NULL;
+  q->head = &q->stub;
+  q->tail = &q->stub;
+}
+
+void queue_push(queue_t *q, void *x) {
+  list_item_t *item = (list_item_t*)x, *prev;
+
+  __atomic_store_n(&item->next, NULL, __ATOMIC_RELAXED);
+  /* seq_cst so that a producer's push is ordered before its check of a
+     consumer's "sleeping" flag (see actor_receive_timeout) */
+  prev = __atomic_exchange_n(&q->head, item, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&prev->next, item, __ATOMIC_RELEASE);
+}
+
+/*
+  Pushes the items first..last, already linked through their next
+  pointers, with a single exchange; the consumer sees them in order.
+*/
+void queue_push_chain(queue_t *q, void *first, void *last) {
+  list_item_t *prev;
+
+  __atomic_store_n(&((list_item_t*)last)->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&q->head, (list_item_t*)last, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&prev->next, (list_item_t*)first, __ATOMIC_RELEASE);
+}
+
+/*
+  Returns NULL when the queue is empty, or when a producer has swapped
+  the head but not linked its item yet. Use queue_empty() to tell the
+  two apart.
+*/
+void *queue_pop(queue_t *q) {
+  list_item_t *tail = q->tail;
+  list_item_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  list_item_t *head;
+
+  if (tail == &q->stub) {
+    if (next == NULL) return NULL;
+    q->tail = next;
+    tail = next;
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  }
+
+  if (next != NULL) {
+    q->tail = next;
+    return tail;
+  }
+
+  head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+  if (tail != head) return NULL;
+
+  /* tail is the last item: put the stub behind it so it can be taken */
+  queue_push(q, &q->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (next != NULL) {
+    q->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+int queue_empty(queue_t *q) {
+  return q->tail == &q->stub &&
+      __atomic_load_n(&q->head, __ATOMIC_SEQ_CST) == &q->stub;
+}
@@ -0,0 +1,52 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_QUEUE_H_
+#define SRC_QUEUE_H_
+
+#include "./list.h"
+
+/*
+  Intrusive multi-producer/single-consumer FIFO (Dmitry Vyukov's design).
+  Items are anything that starts with a list_item_t. queue_push() and
+  queue_push_chain() are wait-free and may be called from any thread;
+  queue_pop() and queue_empty() must only be called by the single
+  consumer.
+*/
+
+#define QUEUE_CACHE_LINE 64
+
+struct queue_struct {
+  list_item_t *head;  /* last pushed item, written by producers */
+  char pad[QUEUE_CACHE_LINE - sizeof(list_item_t *)];
+  list_item_t *tail;  /* next item to pop, owned by the consumer */
+  list_item_t stub;
+};
+typedef struct queue_struct queue_t;
+
+
+void queue_init(queue_t *q);
+
+void queue_push(queue_t *q, void *x);
+void queue_push_chain(queue_t *q, void *first, void *last);
+void *queue_pop(queue_t *q);
+
+int queue_empty(queue_t *q);
+
+#endif  // SRC_QUEUE_H_
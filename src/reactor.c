@@ -0,0 +1,290 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "./reactor.h"
+
+#if defined(__linux__)
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "./epoch.h"
+#include "./slotmap.h"
+
+/* events taken from the kernel per epoll_wait() */
+#define REACTOR_BATCH 64
+
+/* epoll data of the eventfd that wakes the thread for reactor_stop() */
+#define REACTOR_WAKE UINT64_MAX
+
+struct reactor_watch {
+  int fd;
+  long handle;
+  reactor_func_ptr_t func;
+  void *arg;
+};
+
+static pthread_mutex_t reactor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t reactor_thread;
+static int reactor_running = 0;
+static int reactor_stopping = 0;
+static int reactor_epfd = -1;
+static int reactor_wakefd = -1;
+static slotmap_t reactor_registry;
+
+/* the handle watching each descriptor, REACTOR_INVALID if none */
+static long *reactor_fds = NULL;
+static int reactor_nfds = 0;
+
+/* odd while the thread is calling watch functions */
+static unsigned long reactor_batch = 0;
+
+
+static int reactor_events(uint32_t ev) {
+  int events = 0;
+  if (ev & EPOLLIN) events |= REACTOR_READ;
+  if (ev & EPOLLOUT) events |= REACTOR_WRITE;
+  if (ev & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) events |= REACTOR_HUP;
+  return events;
+}
+
+/* called with reactor_mutex held; the watch is freed once no reader is left */
+static void reactor_unlink(long handle) {
+  struct reactor_watch *w = slotmap_remove(&reactor_registry, handle);
+
+  if (w == NULL) return;
+  /* the descriptor may already watch something else, see reactor_add() */
+  if (reactor_fds[w->fd] == handle) {
+    epoll_ctl(reactor_epfd, EPOLL_CTL_DEL, w->fd, NULL);
+    reactor_fds[w->fd] = REACTOR_INVALID;
+  }
+  epoch_retire(w, free);
+}
+
+static void *reactor_main(void *arg) {
+  struct epoll_event events[REACTOR_BATCH];
+  long drop[REACTOR_BATCH];
+  struct reactor_watch *w;
+  int n, ndrop, x;
+
+  while (!__atomic_load_n(&reactor_stopping, __ATOMIC_ACQUIRE)) {
+    n = epoll_wait(reactor_epfd, events, REACTOR_BATCH, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    __atomic_fetch_add(&reactor_batch, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    ndrop = 0;
+    epoch_enter();
+    for (x = 0; x < n; x++) {
+      if (events[x].data.u64 == REACTOR_WAKE) continue;
+      w = slotmap_get(&reactor_registry, (long)events[x].data.u64);
+      if (w == NULL) continue;
+      if (w->func(w->arg, w->fd, reactor_events(events[x].events))) {
+        drop[ndrop++] = w->handle;
+      }
+    }
+    epoch_exit();
+
+    __atomic_fetch_add(&reactor_batch, 1, __ATOMIC_RELEASE);
+
+    if (ndrop > 0) {
+      pthread_mutex_lock(&reactor_mutex);
+      for (x = 0; x < ndrop; x++) reactor_unlink(drop[x]);
+      pthread_mutex_unlock(&reactor_mutex);
+    }
+  }
+
+  return NULL;
+}
+
+/* called with reactor_mutex held */
+static int reactor_start() {
+  struct epoll_event ev;
+
+  if ((reactor_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) return -1;
+  if ((reactor_wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+    close(reactor_epfd);
+    return -1;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.u64 = REACTOR_WAKE;
+  reactor_stopping = 0;
+  if (epoll_ctl(reactor_epfd, EPOLL_CTL_ADD, reactor_wakefd, &ev) != 0 ||
+      pthread_create(&reactor_thread, NULL, reactor_main, NULL) != 0) {
+    close(reactor_wakefd);
+    close(reactor_epfd);
+    return -1;
+  }
+  reactor_running = 1;
+  return 0;
+}
+
+/* called with reactor_mutex held */
+static int reactor_reserve(int fd) {
+  int size = reactor_nfds > 0 ? reactor_nfds : 64;
+  long *fds;
+  int x;
+
+  if (fd < reactor_nfds) return 0;
+  while (size <= fd) size *= 2;
+
+  fds = (long*)realloc(reactor_fds, sizeof(long) * size);
+  if (fds == NULL) return -1;
+  for (x = reactor_nfds; x < size; x++) fds[x] = REACTOR_INVALID;
+  reactor_fds = fds;
+  reactor_nfds = size;
+  return 0;
+}
+
+long reactor_add(int fd, int events, reactor_func_ptr_t func, void *arg) {
+  struct reactor_watch *w;
+  struct epoll_event ev;
+  long handle;
+
+  if (fd < 0) {
+    errno = EBADF;
+    return REACTOR_INVALID;
+  }
+
+  w = (struct reactor_watch*)malloc(sizeof(struct reactor_watch));
+  if (w == NULL) return REACTOR_INVALID;
+  w->fd = fd;
+  w->func = func;
+  w->arg = arg;
+
+  pthread_mutex_lock(&reactor_mutex);
+
+  if ((!reactor_running && reactor_start() != 0) ||
+      reactor_reserve(fd) != 0 ||
+      (handle = slotmap_insert(&reactor_registry, w)) == SLOTMAP_INVALID) {
+    pthread_mutex_unlock(&reactor_mutex);
+    free(w);
+    return REACTOR_INVALID;
+  }
+  w->handle = handle;
+
+  /* a watch left on a descriptor that was closed and reopened is
+     dropped here, in the epoll set too if the kernel kept it there */
+  if (reactor_fds[fd] != REACTOR_INVALID) {
+    epoch_retire(slotmap_remove(&reactor_registry, reactor_fds[fd]), free);
+  }
+
+  ev.events = EPOLLET | EPOLLRDHUP;
+  if (events & REACTOR_READ) ev.events |= EPOLLIN;
+  if (events & REACTOR_WRITE) ev.events |= EPOLLOUT;
+  ev.data.u64 = (uint64_t)handle;
+
+  if (epoll_ctl(reactor_epfd, EPOLL_CTL_ADD, fd, &ev) != 0 &&
+      (errno != EEXIST ||
+       epoll_ctl(reactor_epfd, EPOLL_CTL_MOD, fd, &ev) != 0)) {
+    reactor_fds[fd] = REACTOR_INVALID;
+    slotmap_remove(&reactor_registry, handle);
+    pthread_mutex_unlock(&reactor_mutex);
+    free(w);
+    return REACTOR_INVALID;
+  }
+  reactor_fds[fd] = handle;
+
+  pthread_mutex_unlock(&reactor_mutex);
+
+  return handle;
+}
+
+int reactor_remove(int fd) {
+  unsigned long batch;
+  long handle = REACTOR_INVALID;
+
+  pthread_mutex_lock(&reactor_mutex);
+  if (fd >= 0 && fd < reactor_nfds) handle = reactor_fds[fd];
+  if (handle != REACTOR_INVALID) reactor_unlink(handle);
+  pthread_mutex_unlock(&reactor_mutex);
+
+  if (handle == REACTOR_INVALID) return -1;
+
+  /* a batch that looked the watch up before it was unlinked may still
+     be calling its function */
+  if (!pthread_equal(pthread_self(), reactor_thread)) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    batch = __atomic_load_n(&reactor_batch, __ATOMIC_SEQ_CST);
+    if (batch & 1) {
+      while (__atomic_load_n(&reactor_batch, __ATOMIC_ACQUIRE) == batch) {
+        sched_yield();
+      }
+    }
+  }
+  return 0;
+}
+
+void reactor_stop() {
+  int fd;
+
+  pthread_mutex_lock(&reactor_mutex);
+  if (!reactor_running) {
+    pthread_mutex_unlock(&reactor_mutex);
+    return;
+  }
+  __atomic_store_n(&reactor_stopping, 1, __ATOMIC_RELEASE);
+  eventfd_write(reactor_wakefd, 1);
+  pthread_mutex_unlock(&reactor_mutex);
+
+  pthread_join(reactor_thread, NULL);
+
+  pthread_mutex_lock(&reactor_mutex);
+  for (fd = 0; fd < reactor_nfds; fd++) {
+    if (reactor_fds[fd] != REACTOR_INVALID) {
+      free(slotmap_remove(&reactor_registry, reactor_fds[fd]));
+    }
+  }
+  free(reactor_fds);
+  reactor_fds = NULL;
+  reactor_nfds = 0;
+  slotmap_destroy(&reactor_registry);
+  close(reactor_wakefd);
+  close(reactor_epfd);
+  reactor_running = 0;
+  pthread_mutex_unlock(&reactor_mutex);
+}
+
+#else  // !defined(__linux__)
+
+long reactor_add(int fd, int events, reactor_func_ptr_t func, void *arg) {
+  errno = ENOSYS;
+  return REACTOR_INVALID;
+}
+
+int reactor_remove(int fd) {
+  return -1;
+}
+
+void reactor_stop() {
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,64 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_REACTOR_H_
+#define SRC_REACTOR_H_
+
+/*
+  Readiness notification for file descriptors, on one epoll instance
+  served by a background thread that is started by the first
+  reactor_add().
+
+  Descriptors are watched edge-triggered: a watch's function is called
+  when the descriptor becomes readable or writable, and then not again
+  until it has been drained. Functions run on the reactor thread inside
+  an epoch section, so they must not block. Watches are looked up by
+  generational handles and freed through epoch_retire(), so the thread
+  never calls into a watch that has been removed.
+
+  Only Linux has epoll; elsewhere reactor_add() fails with ENOSYS.
+*/
+
+/* the same bits as ACTOR_IO_READ, ACTOR_IO_WRITE and ACTOR_IO_HUP */
+#define REACTOR_READ  1
+#define REACTOR_WRITE 2
+#define REACTOR_HUP   4
+
+#define REACTOR_INVALID -1
+
+/*
+  Called with the REACTOR_ bits that are ready. Returns nonzero to end
+  the watch, e.g. once the descriptor reached end of file.
+*/
+typedef int (*reactor_func_ptr_t)(void *arg, int fd, int events);
+
+/* replaces any watch on `fd`; returns a handle, or REACTOR_INVALID */
+long reactor_add(int fd, int events, reactor_func_ptr_t func, void *arg);
+
+/*
+  Ends the watch on `fd`, if any. Once it returns the watch's function
+  is not running and will not be called again, so the caller may close
+  `fd`. 0 if there was a watch, -1 otherwise.
+*/
+int reactor_remove(int fd);
+
+/* joins the thread and drops every watch */
+void reactor_stop();
+
+#endif  // SRC_REACTOR_H_
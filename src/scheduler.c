@@ -0,0 +1,519 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "./deque.h"
+#include "./epoch.h"
+#include "./scheduler.h"
+
+enum {
+  FIBER_RUNNING = 0,
+  FIBER_PARKING,   /* switching out to wait for a message */
+  FIBER_PARKED,    /* switched out, only sched_wake() requeues it */
+  FIBER_NOTIFIED,  /* woken while still PARKING */
+  FIBER_DONE
+};
+
+struct sched_fiber {
+  actor_state_t *actor;
+  ucontext_t ctx;
+  void *stack;
+  int state;
+  sched_entry_func_ptr_t entry;
+  void *arg;
+};
+
+struct sched_worker {
+  deque_t deque;
+  pthread_t thread;
+  ucontext_t ctx;
+  actor_state_t *current;
+  unsigned int seed;
+  unsigned int ticks;
+};
+
+/*
+  Runnable actors live on the per-worker deques. The injection queue takes
+  work submitted from outside the pool, overflow from full deques, and
+  actors that used up their turn, so it is also what keeps things fair.
+*/
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;
+static actor_state_t *sched_inject_head = NULL;
+static actor_state_t *sched_inject_tail = NULL;
+static int sched_idle = 0;
+static int sched_stopping = 0;
+static int sched_nworkers = 0;
+static struct sched_worker *sched_workers = NULL;
+
+static pthread_mutex_t sched_stack_mutex = PTHREAD_MUTEX_INITIALIZER;
+static list_item_t *sched_stack_free_list = NULL;
+static long sched_stack_free_count = 0;
+
+static ACTOR_TLS struct sched_worker *sched_self = NULL;
+
+
+/*------------------------------------------------------------------------------
+                                     stacks
+------------------------------------------------------------------------------*/
+
+#ifdef ACTOR_FIBER_GUARD_PAGES
+static size_t sched_page_size() {
+  static size_t page = 0;
+  if (page == 0) page = (size_t)sysconf(_SC_PAGESIZE);
+  return page;
+}
+
+#  define SCHED_STACK_GUARD sched_page_size()
+#else
+#  define SCHED_STACK_GUARD 0
+#endif
+
+#define SCHED_STACK_SPAN (ACTOR_FIBER_STACK_SIZE + SCHED_STACK_GUARD)
+
+/*
+  Stacks are carved out of batch mappings and never unmapped; a free
+  stack keeps the free-list link in its own lowest bytes.
+*/
+static int sched_stack_refill() {
+  char *batch;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  int x;
+
+#ifdef MAP_STACK
+  flags |= MAP_STACK;
+#endif
+  batch = mmap(
+      NULL,
+      SCHED_STACK_SPAN * ACTOR_FIBER_STACK_BATCH,
+      PROT_READ | PROT_WRITE,
+      flags,
+      -1,
+      0);
+  if (batch == MAP_FAILED) return -1;
+
+  for (x = 0; x < ACTOR_FIBER_STACK_BATCH; x++) {
+    char *stack = batch + x * SCHED_STACK_SPAN;
+#ifdef ACTOR_FIBER_GUARD_PAGES
+    mprotect(stack, SCHED_STACK_GUARD, PROT_NONE);
+#endif
+    ((list_item_t*)(stack + SCHED_STACK_GUARD))->next = sched_stack_free_list;
+    sched_stack_free_list = (list_item_t*)(stack + SCHED_STACK_GUARD);
+  }
+  sched_stack_free_count += ACTOR_FIBER_STACK_BATCH;
+  return 0;
+}
+
+/* returns the lowest usable address of an ACTOR_FIBER_STACK_SIZE stack */
+static void *sched_stack_alloc() {
+  void *stack = NULL;
+
+  pthread_mutex_lock(&sched_stack_mutex);
+  if (sched_stack_free_list != NULL || sched_stack_refill() == 0) {
+    stack = list_pop(&sched_stack_free_list);
+    sched_stack_free_count--;
+  }
+  pthread_mutex_unlock(&sched_stack_mutex);
+
+  return stack;
+}
+
+static void sched_stack_free(void *stack) {
+  pthread_mutex_lock(&sched_stack_mutex);
+  if (sched_stack_free_count >= ACTOR_FIBER_STACK_POOL) {
+    madvise(stack, ACTOR_FIBER_STACK_SIZE, MADV_DONTNEED);
+  }
+  ((list_item_t*)stack)->next = sched_stack_free_list;
+  sched_stack_free_list = (list_item_t*)stack;
+  sched_stack_free_count++;
+  pthread_mutex_unlock(&sched_stack_mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+                                    run queues
+------------------------------------------------------------------------------*/
+
+static void sched_notify() {
+  /* pairs with the seq_cst increment of sched_idle in sched_next() */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sched_idle, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&sched_mutex);
+    pthread_cond_signal(&sched_cond);
+    pthread_mutex_unlock(&sched_mutex);
+  }
+}
+
+static void sched_inject(actor_state_t *st) {
+  pthread_mutex_lock(&sched_mutex);
+  st->sched_next = NULL;
+  if (sched_inject_tail == NULL) {
+    /* workers peek at the head without sched_mutex */
+    __atomic_store_n(&sched_inject_head, st, __ATOMIC_RELAXED);
+  } else {
+    sched_inject_tail->sched_next = st;
+  }
+  sched_inject_tail = st;
+  pthread_cond_signal(&sched_cond);
+  pthread_mutex_unlock(&sched_mutex);
+}
+
+/* called with sched_mutex held */
+static actor_state_t *sched_inject_pop() {
+  actor_state_t *st = sched_inject_head;
+  if (st != NULL) {
+    __atomic_store_n(&sched_inject_head, st->sched_next, __ATOMIC_RELAXED);
+    if (st->sched_next == NULL) sched_inject_tail = NULL;
+  }
+  return st;
+}
+
+/* makes st runnable, on the caller's own deque when it is a worker */
+static void sched_submit(actor_state_t *st) {
+  struct sched_worker *w = sched_self;
+
+  if (w != NULL && deque_push(&w->deque, st) == 0) {
+    sched_notify();
+  } else {
+    sched_inject(st);
+  }
+}
+
+static actor_state_t *sched_steal(struct sched_worker *w) {
+  actor_state_t *st;
+  int start = rand_r(&w->seed) % sched_nworkers;
+  int retry = 1;
+  int x;
+
+  while (retry) {
+    retry = 0;
+    for (x = 0; x < sched_nworkers; x++) {
+      struct sched_worker *victim = &sched_workers[(start + x) % sched_nworkers];
+      if (victim == w) continue;
+      st = deque_steal(&victim->deque);
+      if (st == DEQUE_ABORT) {
+        retry = 1;
+      } else if (st != NULL) {
+        return st;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int sched_has_work() {
+  int x;
+  if (sched_inject_head != NULL) return 1;
+  for (x = 0; x < sched_nworkers; x++) {
+    if (!deque_empty(&sched_workers[x].deque)) return 1;
+  }
+  return 0;
+}
+
+/* blocks until something is runnable; NULL once the scheduler stops */
+static actor_state_t *sched_next(struct sched_worker *w) {
+  actor_state_t *st = NULL;
+
+  for (;;) {
+    /* peek at the injection queue now and then so it cannot starve */
+    if (++w->ticks % 61 == 0 &&
+        __atomic_load_n(&sched_inject_head, __ATOMIC_RELAXED) != NULL) {
+      pthread_mutex_lock(&sched_mutex);
+      st = sched_inject_pop();
+      pthread_mutex_unlock(&sched_mutex);
+      if (st != NULL) return st;
+    }
+
+    if ((st = deque_take(&w->deque)) != NULL) return st;
+    if ((st = sched_steal(w)) != NULL) return st;
+
+    pthread_mutex_lock(&sched_mutex);
+    if ((st = sched_inject_pop()) != NULL || sched_stopping) {
+      pthread_mutex_unlock(&sched_mutex);
+      return st;
+    }
+    __atomic_add_fetch(&sched_idle, 1, __ATOMIC_SEQ_CST);
+    if (!sched_has_work()) pthread_cond_wait(&sched_cond, &sched_mutex);
+    __atomic_sub_fetch(&sched_idle, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&sched_mutex);
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                     fibers
+------------------------------------------------------------------------------*/
+
+/*
+  A fiber can resume on a different worker than the one it left, so code
+  that runs on both sides of a switch must re-read the worker through
+  this function rather than let the compiler reuse a cached TLS address.
+*/
+static __attribute__((noinline)) struct sched_worker *sched_worker_self() {
+  __asm__ __volatile__("" ::: "memory");
+  return sched_self;
+}
+
+static void sched_switch_out(struct sched_fiber *f) {
+  swapcontext(&f->ctx, &sched_worker_self()->ctx);
+}
+
+/* satisfies epoch_free_func_ptr_t */
+static void sched_fiber_free(void *arg) {
+  struct sched_fiber *f = (struct sched_fiber*)arg;
+  sched_stack_free(f->stack);
+  free(f);
+}
+
+static void sched_fiber_main() {
+  struct sched_fiber *f = sched_worker_self()->current->fiber;
+
+  f->entry(f->arg);
+
+  __atomic_store_n(&f->state, FIBER_DONE, __ATOMIC_RELEASE);
+  sched_switch_out(f);
+}
+
+static void sched_run_fiber(struct sched_worker *w, actor_state_t *st) {
+  struct sched_fiber *f = st->fiber;
+  int expected;
+
+  swapcontext(&w->ctx, &f->ctx);
+
+  switch (__atomic_load_n(&f->state, __ATOMIC_ACQUIRE)) {
+    case FIBER_DONE:
+      /* late senders may still be looking at the fiber's state */
+      epoch_retire(f, sched_fiber_free);
+      break;
+    case FIBER_PARKING:
+      expected = FIBER_PARKING;
+      if (__atomic_compare_exchange_n(
+              &f->state, &expected, FIBER_PARKED, 0,
+              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        break;
+      }
+      /* NOTIFIED: a message arrived while it was switching out */
+      __atomic_store_n(&f->state, FIBER_RUNNING, __ATOMIC_RELAXED);
+      sched_submit(st);
+      break;
+    default:  /* yielded: back of the line */
+      sched_inject(st);
+      break;
+  }
+}
+
+
+/*------------------------------------------------------------------------------
+                                 handler actors
+------------------------------------------------------------------------------*/
+
+static void sched_run_handler(actor_state_t *st) {
+  int expected = 0;
+
+  switch (_actor_run_handler(st, ACTOR_HANDLER_BATCH)) {
+    case SCHED_DONE:
+      break;
+    case SCHED_BUSY:  /* used up its turn, let the others run */
+      sched_inject(st);
+      break;
+    default:
+      /* pairs with the seq_cst push in queue_push(): either the sender
+         sees `scheduled` cleared or we see its message */
+      __atomic_store_n(&st->scheduled, 0, __ATOMIC_SEQ_CST);
+      if (!_actor_mailbox_empty(st) &&
+          __atomic_compare_exchange_n(
+              &st->scheduled, &expected, 1, 0,
+              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        sched_submit(st);
+      }
+      break;
+  }
+}
+
+static void *sched_worker_main(void *arg) {
+  struct sched_worker *w = (struct sched_worker*)arg;
+  actor_state_t *st;
+
+  sched_self = w;
+
+  while ((st = sched_next(w)) != NULL) {
+    w->current = st;
+    if (st->fiber != NULL) {
+      sched_run_fiber(w, st);
+    } else {
+      sched_run_handler(st);
+    }
+    w->current = NULL;
+  }
+
+  sched_self = NULL;
+  return NULL;
+}
+
+
+/*------------------------------------------------------------------------------
+                                  public interface
+------------------------------------------------------------------------------*/
+
+int sched_start(int workers) {
+  int x;
+
+  if (sched_workers != NULL) return 0;
+  if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (workers <= 0) workers = 1;
+
+  sched_workers = calloc(workers, sizeof(struct sched_worker));
+  if (sched_workers == NULL) return -1;
+
+  sched_stopping = 0;
+  sched_nworkers = workers;
+  for (x = 0; x < workers; x++) {
+    deque_init(&sched_workers[x].deque);
+    sched_workers[x].seed = (unsigned int)x + 1;
+  }
+  for (x = 0; x < workers; x++) {
+    if (pthread_create(
+            &sched_workers[x].thread,
+            NULL,
+            sched_worker_main,
+            &sched_workers[x]) != 0) {
+      break;
+    }
+  }
+  sched_nworkers = x;
+
+  if (sched_nworkers == 0) {
+    free(sched_workers);
+    sched_workers = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+void sched_stop() {
+  int x;
+
+  if (sched_workers == NULL) return;
+
+  pthread_mutex_lock(&sched_mutex);
+  sched_stopping = 1;
+  pthread_cond_broadcast(&sched_cond);
+  pthread_mutex_unlock(&sched_mutex);
+
+  for (x = 0; x < sched_nworkers; x++) {
+    pthread_join(sched_workers[x].thread, NULL);
+  }
+  free(sched_workers);
+  sched_workers = NULL;
+  sched_nworkers = 0;
+}
+
+int sched_running() {
+  return sched_workers != NULL;
+}
+
+int sched_spawn(actor_state_t *st, sched_entry_func_ptr_t entry, void *arg) {
+  struct sched_fiber *f = calloc(1, sizeof(struct sched_fiber));
+
+  if (f == NULL) return -1;
+  if ((f->stack = sched_stack_alloc()) == NULL) {
+    free(f);
+    return -1;
+  }
+
+  getcontext(&f->ctx);
+  f->ctx.uc_stack.ss_sp = f->stack;
+  f->ctx.uc_stack.ss_size = ACTOR_FIBER_STACK_SIZE;
+  f->ctx.uc_link = NULL;
+  makecontext(&f->ctx, sched_fiber_main, 0);
+
+  f->actor = st;
+  f->entry = entry;
+  f->arg = arg;
+  f->state = FIBER_RUNNING;
+  __atomic_store_n(&st->fiber, f, __ATOMIC_SEQ_CST);
+
+  sched_submit(st);
+  return 0;
+}
+
+/* for fibers that never finished; the scheduler must be stopped */
+void sched_free(actor_state_t *st) {
+  if (st->fiber == NULL) return;
+  sched_fiber_free(st->fiber);
+  st->fiber = NULL;
+}
+
+actor_state_t *sched_current() {
+  struct sched_worker *w = sched_self;
+  return (w != NULL) ? w->current : NULL;
+}
+
+void sched_park(actor_state_t *st) {
+  struct sched_fiber *f = st->fiber;
+
+  /* pairs with the seq_cst push in queue_push() and load in sched_wake() */
+  __atomic_store_n(&f->state, FIBER_PARKING, __ATOMIC_SEQ_CST);
+  if (_actor_wakeup_pending(st)) {
+    __atomic_store_n(&f->state, FIBER_RUNNING, __ATOMIC_SEQ_CST);
+    return;
+  }
+  sched_switch_out(f);
+}
+
+void sched_fiber_yield() {
+  sched_switch_out(sched_worker_self()->current->fiber);
+}
+
+void sched_wake(actor_state_t *st) {
+  struct sched_fiber *f = st->fiber;
+  int s = 0;
+
+  if (f == NULL) {  /* handler actor */
+    if (__atomic_compare_exchange_n(
+            &st->scheduled, &s, 1, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      sched_submit(st);
+    }
+    return;
+  }
+
+  for (;;) {
+    s = __atomic_load_n(&f->state, __ATOMIC_SEQ_CST);
+    if (s == FIBER_PARKED) {
+      if (__atomic_compare_exchange_n(
+              &f->state, &s, FIBER_RUNNING, 0,
+              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        sched_submit(st);
+        return;
+      }
+    } else if (s == FIBER_PARKING) {
+      if (__atomic_compare_exchange_n(
+              &f->state, &s, FIBER_NOTIFIED, 0,
+              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return;
+      }
+    } else {
+      return;
+    }
+  }
+}
@@ -0,0 +1,97 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_SCHEDULER_H_
+#define SRC_SCHEDULER_H_
+
+/*
+  M:N scheduler: actors run as user-space fibers or run-to-completion
+  handlers multiplexed over a fixed pool of worker threads. Each worker
+  owns a work-stealing deque of runnable actors and idle workers steal
+  from the others. A fiber only gives up its worker when it parks
+  (actor_receive() on an empty mailbox) or yields; blocking system calls
+  block the whole worker.
+
+  Fibers never touch the run queue directly. sched_park() and
+  sched_fiber_yield() switch back to the worker, which decides on its own stack
+  whether the fiber is requeued, so a fiber is never resumed by a second
+  worker while it is still running on the first.
+*/
+
+#include "./actor.h"
+
+#ifndef ACTOR_FIBER_STACK_SIZE
+#define ACTOR_FIBER_STACK_SIZE (64 * 1024)
+#endif
+
+/* stacks are mapped this many at a time */
+#ifndef ACTOR_FIBER_STACK_BATCH
+#define ACTOR_FIBER_STACK_BATCH 64
+#endif
+
+/* free stacks beyond this many give their pages back to the kernel */
+#ifndef ACTOR_FIBER_STACK_POOL
+#define ACTOR_FIBER_STACK_POOL 4096
+#endif
+
+/*
+  Define ACTOR_FIBER_GUARD_PAGES to put a PROT_NONE page below every
+  stack. Each guard page splits the mapping, which limits the number of
+  fibers to about half of vm.max_map_count.
+*/
+
+/* messages a handler actor may process before it goes to the back */
+#ifndef ACTOR_HANDLER_BATCH
+#define ACTOR_HANDLER_BATCH 64
+#endif
+
+enum {
+  SCHED_IDLE = 0,  /* mailbox drained */
+  SCHED_BUSY,      /* messages left over */
+  SCHED_DONE       /* actor exited and was torn down */
+};
+
+typedef void (*sched_entry_func_ptr_t)(void *);
+
+/* implemented in actor.c: handles up to `batch` messages of st */
+int _actor_run_handler(actor_state_t *st, int batch);
+
+/* implemented in actor.c: no lane of st's mailbox has a message */
+int _actor_mailbox_empty(actor_state_t *st);
+
+/* implemented in actor.c: a message or a receive timeout is waiting */
+int _actor_wakeup_pending(actor_state_t *st);
+
+int sched_start(int workers);
+void sched_stop();
+int sched_running();
+
+int sched_spawn(actor_state_t *st, sched_entry_func_ptr_t entry, void *arg);
+void sched_free(actor_state_t *st);
+
+actor_state_t *sched_current();
+
+/* called by the running fiber */
+void sched_park(actor_state_t *st);
+void sched_fiber_yield();
+
+/* called by anyone after pushing to a fiber's or handler's mailbox */
+void sched_wake(actor_state_t *st);
+
+#endif  // SRC_SCHEDULER_H_
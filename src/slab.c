@@ -0,0 +1,335 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./slab.h"
+#include "./topology.h"
+
+#if defined(_MSC_VER)
+#  define SLAB_TLS __declspec(thread)
+#else
+#  define SLAB_TLS __thread
+#endif  // defined(_MSC_VER)
+
+/* multiples of 16 so that every object keeps malloc()'s alignment */
+static const size_t slab_sizes[] = {
+  48, 64, 96, 128, 144, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+  SLAB_MAX_SIZE
+};
+#define SLAB_CLASSES ((int)(sizeof(slab_sizes) / sizeof(slab_sizes[0])))
+
+int slab_class(size_t size) {
+  int x;
+
+  for (x = 0; x < SLAB_CLASSES; x++) {
+    if (size <= slab_sizes[x]) return x;
+  }
+  return SLAB_NONE;
+}
+
+#if defined(ACTOR_NO_SLAB)
+
+/* objects come straight from malloc(), to measure what the caches save */
+void *slab_alloc(int sclass) {
+  return malloc(slab_sizes[sclass]);
+}
+
+void slab_free(void *obj, int sclass) {
+  free(obj);
+}
+
+void slab_set_node(int node) {
+}
+
+#else  // !defined(ACTOR_NO_SLAB)
+
+
+struct slab_magazine {
+  struct slab_magazine *next;
+  int count;
+  void *objs[SLAB_MAGAZINE_SIZE];
+};
+
+struct slab_depot {
+  pthread_mutex_t mutex;
+  struct slab_magazine *full;
+  struct slab_magazine *empty;
+  struct slab_magazine *partial;  /* collects objects freed on other nodes */
+};
+
+/* at the start of every chunk; objects follow at SLAB_CHUNK_HEADER */
+struct slab_chunk {
+  int node;
+};
+
+/* keeps the objects 16-byte aligned, and off the header's cache line */
+#define SLAB_CHUNK_HEADER 64
+
+#define SLAB_NODES TOPOLOGY_MAX_NODES
+
+/* `loaded` is used first; `previous` is kept full or empty */
+struct slab_cache {
+  struct slab_magazine *loaded[SLAB_CLASSES];
+  struct slab_magazine *previous[SLAB_CLASSES];
+  int node;  /* the depots used, an index into slab_depots */
+  int registered;
+};
+
+static struct slab_depot slab_depots[SLAB_NODES][SLAB_CLASSES];
+static size_t slab_chunk_sizes[SLAB_CLASSES];
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slab_key;
+
+static SLAB_TLS struct slab_cache slab_self;
+
+
+/* takes a magazine from `*list`, called with the depot's mutex held */
+static struct slab_magazine *slab_depot_pop(struct slab_magazine **list) {
+  struct slab_magazine *m = *list;
+  if (m != NULL) *list = m->next;
+  return m;
+}
+
+static void slab_depot_push(struct slab_magazine **list,
+                            struct slab_magazine *m) {
+  m->next = *list;
+  *list = m;
+}
+
+static void slab_depot_put(int node, int sclass, struct slab_magazine *m) {
+  struct slab_depot *d = &slab_depots[node][sclass];
+
+  pthread_mutex_lock(&d->mutex);
+  slab_depot_push(m->count == 0 ? &d->empty : &d->full, m);
+  pthread_mutex_unlock(&d->mutex);
+}
+
+/* returns the caller's magazines to its node's depots */
+static void slab_cache_flush(struct slab_cache *c) {
+  int x;
+
+  for (x = 0; x < SLAB_CLASSES; x++) {
+    if (c->loaded[x] != NULL) slab_depot_put(c->node, x, c->loaded[x]);
+    if (c->previous[x] != NULL) slab_depot_put(c->node, x, c->previous[x]);
+    c->loaded[x] = NULL;
+    c->previous[x] = NULL;
+  }
+}
+
+static void slab_thread_exit(void *arg) {
+  struct slab_cache *c = (struct slab_cache*)arg;
+
+  slab_cache_flush(c);
+  c->node = 0;
+  c->registered = 0;
+}
+
+static void slab_key_init() {
+  int x, y;
+
+  pthread_key_create(&slab_key, slab_thread_exit);
+  for (x = 0; x < SLAB_CLASSES; x++) {
+    slab_chunk_sizes[x] = SLAB_CHUNK_HEADER;
+    while (slab_chunk_sizes[x] <
+           SLAB_CHUNK_HEADER + slab_sizes[x] * SLAB_MAGAZINE_SIZE) {
+      slab_chunk_sizes[x] *= 2;
+    }
+  }
+  for (x = 0; x < SLAB_NODES; x++) {
+    for (y = 0; y < SLAB_CLASSES; y++) {
+      pthread_mutex_init(&slab_depots[x][y].mutex, NULL);
+    }
+  }
+}
+
+static struct slab_cache *slab_cache_get() {
+  struct slab_cache *c = &slab_self;
+
+  if (!c->registered) {
+    pthread_once(&slab_once, slab_key_init);
+    pthread_setspecific(slab_key, c);
+    c->registered = 1;
+  }
+  return c;
+}
+
+/* the node whose chunk `obj` was carved from */
+static int slab_home(void *obj, int sclass) {
+  uintptr_t mask = (uintptr_t)slab_chunk_sizes[sclass] - 1;
+  return ((struct slab_chunk*)((uintptr_t)obj & ~mask))->node;
+}
+
+/*
+  Carves a new chunk for `node` into magazines, returning the first and
+  leaving the others in the node's depot.
+*/
+static struct slab_magazine *slab_grow(int node, int sclass) {
+  size_t size = slab_sizes[sclass];
+  struct slab_magazine *first = NULL;
+  struct slab_magazine *m = NULL;
+  struct slab_chunk *chunk;
+  char *obj, *end;
+
+  if (posix_memalign((void**)&chunk,
+                     slab_chunk_sizes[sclass],
+                     slab_chunk_sizes[sclass]) != 0) {
+    return NULL;
+  }
+  chunk->node = node;
+
+  obj = (char*)chunk + SLAB_CHUNK_HEADER;
+  end = (char*)chunk + slab_chunk_sizes[sclass];
+  for (; obj + size <= end; obj += size) {
+    if (m == NULL || m->count == SLAB_MAGAZINE_SIZE) {
+      if (m != NULL && m != first) slab_depot_put(node, sclass, m);
+      m = (struct slab_magazine*)malloc(sizeof(struct slab_magazine));
+      assert(m != NULL);
+      m->count = 0;
+      if (first == NULL) first = m;
+    }
+    m->objs[m->count++] = obj;
+  }
+  if (m != first) slab_depot_put(node, sclass, m);
+
+  return first;
+}
+
+/* gives an object freed on another node back to its home node's depot */
+static void slab_free_remote(void *obj, int node, int sclass) {
+  struct slab_depot *d = &slab_depots[node][sclass];
+  struct slab_magazine *m = NULL;
+
+  pthread_mutex_lock(&d->mutex);
+  if (d->partial == NULL) d->partial = slab_depot_pop(&d->empty);
+  if (d->partial == NULL) {
+    /* malloc() the magazine unlocked; someone may beat us to it */
+    pthread_mutex_unlock(&d->mutex);
+    m = (struct slab_magazine*)malloc(sizeof(struct slab_magazine));
+    assert(m != NULL);
+    pthread_mutex_lock(&d->mutex);
+    if (d->partial == NULL) {
+      m->count = 0;
+      d->partial = m;
+      m = NULL;
+    }
+  }
+  d->partial->objs[d->partial->count++] = obj;
+  if (d->partial->count == SLAB_MAGAZINE_SIZE) {
+    slab_depot_push(&d->full, d->partial);
+    d->partial = NULL;
+  }
+  pthread_mutex_unlock(&d->mutex);
+
+  free(m);
+}
+
+void *slab_alloc(int sclass) {
+  struct slab_cache *c = slab_cache_get();
+  struct slab_depot *d = &slab_depots[c->node][sclass];
+  struct slab_magazine *m = c->loaded[sclass];
+  struct slab_magazine *full;
+
+  if (m != NULL && m->count > 0) return m->objs[--m->count];
+
+  /* both magazines empty: trade one for a full one from the depot */
+  if (c->previous[sclass] != NULL && c->previous[sclass]->count > 0) {
+    c->loaded[sclass] = c->previous[sclass];
+    c->previous[sclass] = m;
+  } else {
+    pthread_mutex_lock(&d->mutex);
+    full = slab_depot_pop(&d->full);
+    if (full == NULL && d->partial != NULL) {
+      full = d->partial;
+      d->partial = NULL;
+    }
+    if (c->previous[sclass] != NULL) {
+      slab_depot_push(&d->empty, c->previous[sclass]);
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    if (full == NULL && (full = slab_grow(c->node, sclass)) == NULL) {
+      c->previous[sclass] = NULL;
+      return NULL;
+    }
+    c->previous[sclass] = m;
+    c->loaded[sclass] = full;
+  }
+
+  m = c->loaded[sclass];
+  return m->objs[--m->count];
+}
+
+void slab_free(void *obj, int sclass) {
+  struct slab_cache *c = slab_cache_get();
+  struct slab_depot *d = &slab_depots[c->node][sclass];
+  struct slab_magazine *m = c->loaded[sclass];
+  struct slab_magazine *empty;
+  int home = slab_home(obj, sclass);
+
+  if (home != c->node) {
+    slab_free_remote(obj, home, sclass);
+    return;
+  }
+
+  if (m != NULL && m->count < SLAB_MAGAZINE_SIZE) {
+    m->objs[m->count++] = obj;
+    return;
+  }
+
+  /* both magazines full: trade one for an empty one from the depot */
+  if (c->previous[sclass] != NULL &&
+      c->previous[sclass]->count < SLAB_MAGAZINE_SIZE) {
+    c->loaded[sclass] = c->previous[sclass];
+    c->previous[sclass] = m;
+  } else {
+    pthread_mutex_lock(&d->mutex);
+    empty = slab_depot_pop(&d->empty);
+    if (c->previous[sclass] != NULL) {
+      slab_depot_push(&d->full, c->previous[sclass]);
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    if (empty == NULL) {
+      empty = (struct slab_magazine*)malloc(sizeof(struct slab_magazine));
+      assert(empty != NULL);
+    }
+    empty->count = 0;
+    c->previous[sclass] = m;
+    c->loaded[sclass] = empty;
+  }
+
+  m = c->loaded[sclass];
+  m->objs[m->count++] = obj;
+}
+
+void slab_set_node(int node) {
+  struct slab_cache *c = slab_cache_get();
+
+  assert(node >= -1 && node < SLAB_NODES);
+  if (node < 0) node = 0;
+  if (node == c->node) return;
+  slab_cache_flush(c);
+  c->node = node;
+}
+
+#endif  // defined(ACTOR_NO_SLAB)
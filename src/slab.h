@@ -0,0 +1,66 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_SLAB_H_
+#define SRC_SLAB_H_
+
+#include <stddef.h>
+
+/*
+  Size-class object cache for small, short-lived allocations.
+
+  Each thread keeps two magazines (fixed arrays of free objects) per size
+  class and serves slab_alloc()/slab_free() from them without locking.
+  Full and empty magazines are exchanged with a per-class depot, so an
+  object freed on one thread finds its way back to threads that allocate
+  it, one magazine at a time. A thread's magazines go back to the depot
+  when it exits. Memory is taken in chunks of at least a magazine's
+  worth, aligned to their power-of-two size, and is never handed back.
+
+  Each NUMA node has its own depots, and each chunk records the node of
+  the thread that carved it. A thread only caches objects of its own
+  node: an object freed on another node goes straight back to its home
+  node's depot, so memory never drifts to the node that freed it.
+  Threads use node 0 until slab_set_node() says otherwise.
+
+  Building with ACTOR_NO_SLAB (the ACTOR_SLAB CMake option turned off)
+  sends every allocation to malloc() instead, for comparison.
+*/
+
+#define SLAB_MAGAZINE_SIZE 64
+
+/* the largest size served from a size class; bigger ones use malloc() */
+#define SLAB_MAX_SIZE 4096
+
+#define SLAB_NONE -1
+
+/* the size class for `size` bytes, or SLAB_NONE if it is too large */
+int slab_class(size_t size);
+
+void *slab_alloc(int sclass);
+void slab_free(void *obj, int sclass);
+
+/*
+  Moves the calling thread's magazines back to the depots of its current
+  node and has it allocate from `node`, one of topology.h's node ids, or
+  node 0 for -1.
+*/
+void slab_set_node(int node);
+
+#endif  // SRC_SLAB_H_
@@ -0,0 +1,154 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <limits.h>
+#include <string.h>
+
+#include "./slotmap.h"
+
+/* generations are kept small enough that a handle is never negative */
+#define SLOTMAP_GEN_MASK ((unsigned long)LONG_MAX >> SLOTMAP_INDEX_BITS)
+
+static struct slotmap_slot *slotmap_slot_at(slotmap_t *map, long index) {
+  struct slotmap_slot *chunk = __atomic_load_n(
+      &map->chunks[index >> SLOTMAP_CHUNK_BITS],
+      __ATOMIC_ACQUIRE);
+  if (chunk == NULL) return NULL;
+  return &chunk[index & (SLOTMAP_CHUNK_SIZE - 1)];
+}
+
+static long slotmap_handle(long index, unsigned long generation) {
+  return (long)((generation << SLOTMAP_INDEX_BITS) | (unsigned long)index);
+}
+
+void slotmap_init(slotmap_t *map) {
+  memset(map, 0, sizeof(slotmap_t));
+}
+
+void slotmap_destroy(slotmap_t *map) {
+  long x;
+  for (x = 0; x < SLOTMAP_MAX_CHUNKS; x++) {
+    free(map->chunks[x]);
+  }
+  slotmap_init(map);
+}
+
+long slotmap_insert(slotmap_t *map, void *item) {
+  struct slotmap_slot *slot;
+  long index;
+
+  if (map->free_head != 0) {
+    index = map->free_head - 1;
+    slot = slotmap_slot_at(map, index);
+    map->free_head = slot->next_free;
+  } else {
+    index = map->size;
+    if (index > SLOTMAP_INDEX_MASK) return SLOTMAP_INVALID;
+    if (map->chunks[index >> SLOTMAP_CHUNK_BITS] == NULL) {
+      slot = calloc(SLOTMAP_CHUNK_SIZE, sizeof(struct slotmap_slot));
+      if (slot == NULL) return SLOTMAP_INVALID;
+      __atomic_store_n(
+          &map->chunks[index >> SLOTMAP_CHUNK_BITS],
+          slot,
+          __ATOMIC_RELEASE);
+    }
+    slot = slotmap_slot_at(map, index);
+    slot->generation = 1;
+    __atomic_store_n(&map->size, map->size + 1, __ATOMIC_RELEASE);
+  }
+
+  slot->next_free = 0;
+  __atomic_store_n(&slot->item, item, __ATOMIC_RELEASE);
+  __atomic_store_n(&map->count, map->count + 1, __ATOMIC_RELAXED);
+
+  return slotmap_handle(index, slot->generation);
+}
+
+/*
+  May run concurrently with slotmap_insert() and slotmap_remove(), which
+  must be serialized by the caller. The returned item is only guaranteed
+  to stay allocated if the caller arranges for that, e.g. by looking it up
+  inside an epoch_enter()/epoch_exit() section.
+*/
+void *slotmap_get(slotmap_t *map, long handle) {
+  struct slotmap_slot *slot;
+  unsigned long generation = (unsigned long)handle >> SLOTMAP_INDEX_BITS;
+  long index;
+  void *item;
+
+  if (handle < 0) return NULL;
+  index = handle & SLOTMAP_INDEX_MASK;
+  if (index >= __atomic_load_n(&map->size, __ATOMIC_ACQUIRE)) return NULL;
+
+  slot = slotmap_slot_at(map, index);
+  if (__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) != generation) {
+    return NULL;
+  }
+  item = __atomic_load_n(&slot->item, __ATOMIC_ACQUIRE);
+
+  /* the slot may have been recycled between the two loads */
+  if (__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) != generation) {
+    return NULL;
+  }
+  return item;
+}
+
+void *slotmap_remove(slotmap_t *map, long handle) {
+  struct slotmap_slot *slot;
+  unsigned long generation;
+  void *item = slotmap_get(map, handle);
+  long index = handle & SLOTMAP_INDEX_MASK;
+
+  if (item == NULL) return NULL;
+
+  slot = slotmap_slot_at(map, index);
+  generation = (slot->generation + 1) & SLOTMAP_GEN_MASK;
+  if (generation == 0) generation = 1;
+  __atomic_store_n(&slot->generation, generation, __ATOMIC_RELEASE);
+  __atomic_store_n(&slot->item, NULL, __ATOMIC_RELEASE);
+  slot->next_free = map->free_head;
+  map->free_head = index + 1;
+  __atomic_store_n(&map->count, map->count - 1, __ATOMIC_RELAXED);
+
+  return item;
+}
+
+long slotmap_count(slotmap_t *map) {
+  return __atomic_load_n(&map->count, __ATOMIC_RELAXED);
+}
+
+/*
+  Returns the next live item at or after *cursor and advances the cursor
+  past it, or NULL once the map is exhausted. Start with *cursor = 0.
+*/
+void *slotmap_next(slotmap_t *map, long *cursor) {
+  struct slotmap_slot *slot;
+  long size = __atomic_load_n(&map->size, __ATOMIC_ACQUIRE);
+  void *item;
+
+  for (; *cursor < size; (*cursor)++) {
+    slot = slotmap_slot_at(map, *cursor);
+    item = __atomic_load_n(&slot->item, __ATOMIC_ACQUIRE);
+    if (item != NULL) {
+      (*cursor)++;
+      return item;
+    }
+  }
+  return NULL;
+}
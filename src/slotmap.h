@@ -0,0 +1,70 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_SLOTMAP_H_
+#define SRC_SLOTMAP_H_
+
+#include <stdlib.h>
+
+/*
+  A slot map hands out handles made of a slot index and a generation.
+  Insert, lookup and remove are O(1); removing an item bumps the slot's
+  generation, so stale handles fail the lookup instead of aliasing the
+  next item stored in the same slot.
+
+  Slots live in fixed-size chunks that are never moved or freed before
+  slotmap_destroy(), so a slot's address is stable for the lifetime of
+  the map. A zero-filled slotmap_t is a valid, empty map.
+*/
+
+#define SLOTMAP_INDEX_BITS  22
+#define SLOTMAP_CHUNK_BITS  12
+#define SLOTMAP_CHUNK_SIZE  (1L << SLOTMAP_CHUNK_BITS)
+#define SLOTMAP_MAX_CHUNKS  (1L << (SLOTMAP_INDEX_BITS - SLOTMAP_CHUNK_BITS))
+#define SLOTMAP_INDEX_MASK  ((1L << SLOTMAP_INDEX_BITS) - 1)
+
+#define SLOTMAP_INVALID -1
+
+struct slotmap_slot {
+  void *item;
+  unsigned long generation;
+  long next_free;  /* index + 1 of the next free slot, 0 ends the list */
+};
+
+struct slotmap_struct {
+  struct slotmap_slot *chunks[SLOTMAP_MAX_CHUNKS];
+  long free_head;  /* index + 1 of the first free slot, 0 if none */
+  long size;       /* number of slots ever handed out */
+  long count;      /* number of live items */
+};
+typedef struct slotmap_struct slotmap_t;
+
+
+void slotmap_init(slotmap_t *map);
+void slotmap_destroy(slotmap_t *map);
+
+long slotmap_insert(slotmap_t *map, void *item);
+void *slotmap_get(slotmap_t *map, long handle);
+void *slotmap_remove(slotmap_t *map, long handle);
+
+long slotmap_count(slotmap_t *map);
+
+void *slotmap_next(slotmap_t *map, long *cursor);
+
+#endif  // SRC_SLOTMAP_H_
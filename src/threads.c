@@ -0,0 +1,180 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./threads.h"
+
+struct threads_thread {
+  struct threads_thread *next;  /* while parked */
+  pthread_cond_t cond;  /* on CLOCK_MONOTONIC, see threads_run() */
+  threads_func_ptr_t func;  /* NULL while parked */
+  void *arg;
+  size_t stack_size;
+  long guard_size;
+};
+
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threads_stopped = PTHREAD_COND_INITIALIZER;
+static struct threads_thread *threads_list = NULL;  /* most recent first */
+static int threads_count = 0;
+static int threads_stopping = 0;
+
+
+/* called with threads_mutex held */
+static void threads_unlink(struct threads_thread *t) {
+  struct threads_thread **pp;
+
+  for (pp = &threads_list; *pp != NULL; pp = &(*pp)->next) {
+    if (*pp == t) {
+      *pp = t->next;
+      threads_count--;
+      return;
+    }
+  }
+}
+
+/*
+  Parks t until it is handed a function; returns 0 if it should exit
+  instead. Called with threads_mutex held.
+*/
+static int threads_park(struct threads_thread *t) {
+  struct timespec ts;
+
+  if (threads_stopping || threads_count >= ACTOR_THREAD_CACHE) return 0;
+
+  t->func = NULL;
+  t->next = threads_list;
+  threads_list = t;
+  threads_count++;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += ACTOR_THREAD_CACHE_IDLE;
+  while (t->func == NULL && !threads_stopping) {
+    if (pthread_cond_timedwait(&t->cond, &threads_mutex, &ts) == ETIMEDOUT) {
+      break;
+    }
+  }
+
+  /* threads_run() unlinks the threads it hands work to */
+  if (t->func != NULL) return 1;
+  threads_unlink(t);
+  if (threads_count == 0) pthread_cond_broadcast(&threads_stopped);
+  return 0;
+}
+
+static void *threads_main(void *arg) {
+  struct threads_thread *t = (struct threads_thread*)arg;
+  int again = 1;
+
+  while (again) {
+    t->func(t->arg);
+
+    pthread_mutex_lock(&threads_mutex);
+    again = threads_park(t);
+    pthread_mutex_unlock(&threads_mutex);
+  }
+
+  pthread_cond_destroy(&t->cond);
+  free(t);
+  return NULL;
+}
+
+int threads_run(
+    threads_func_ptr_t func,
+    void *arg,
+    size_t stack_size,
+    long guard_size) {
+
+  struct threads_thread *t;
+  pthread_condattr_t cond_attr;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int ret;
+
+  /* the most recently parked thread has the warmest stack and caches */
+  pthread_mutex_lock(&threads_mutex);
+  for (t = threads_list; t != NULL; t = t->next) {
+    if (t->stack_size == stack_size && t->guard_size == guard_size) break;
+  }
+  if (t != NULL) {
+    threads_unlink(t);
+    t->func = func;
+    t->arg = arg;
+    pthread_cond_signal(&t->cond);
+  }
+  pthread_mutex_unlock(&threads_mutex);
+  if (t != NULL) return 0;
+
+  t = (struct threads_thread*)malloc(sizeof(struct threads_thread));
+  if (t == NULL) return ENOMEM;
+  /* a wall clock step must not cut a parked thread's idle time short */
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&t->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  t->func = func;
+  t->arg = arg;
+  t->stack_size = stack_size;
+  t->guard_size = guard_size;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = 0;
+  if (stack_size != 0) ret = pthread_attr_setstacksize(&attr, stack_size);
+  if (ret == 0 && guard_size >= 0) {
+    ret = pthread_attr_setguardsize(&attr, (size_t)guard_size);
+  }
+  if (ret == 0) ret = pthread_create(&thread, &attr, threads_main, t);
+  pthread_attr_destroy(&attr);
+
+  if (ret != 0) {
+    pthread_cond_destroy(&t->cond);
+    free(t);
+  }
+  return ret;
+}
+
+int threads_parked() {
+  int count;
+
+  pthread_mutex_lock(&threads_mutex);
+  count = threads_count;
+  pthread_mutex_unlock(&threads_mutex);
+  return count;
+}
+
+void threads_stop() {
+  struct threads_thread *t;
+
+  pthread_mutex_lock(&threads_mutex);
+  threads_stopping = 1;
+  for (t = threads_list; t != NULL; t = t->next) {
+    pthread_cond_signal(&t->cond);
+  }
+  while (threads_count > 0) {
+    pthread_cond_wait(&threads_stopped, &threads_mutex);
+  }
+  /* threads still running a function park again once it returns */
+  threads_stopping = 0;
+  pthread_mutex_unlock(&threads_mutex);
+}
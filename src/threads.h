@@ -0,0 +1,63 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_THREADS_H_
+#define SRC_THREADS_H_
+
+#include <stddef.h>
+
+/*
+  Cache of parked threads for thread-per-actor mode.
+
+  A thread whose function has returned parks instead of exiting, and the
+  next threads_run() with the same stack size and guard hands it the new
+  function, which costs a condition variable signal instead of a
+  pthread_create(), a fresh stack mapping and a pthread_exit(). At most
+  ACTOR_THREAD_CACHE threads are parked at once; one left unused for
+  ACTOR_THREAD_CACHE_IDLE seconds exits. Threads are created detached.
+*/
+
+#ifndef ACTOR_THREAD_CACHE
+#define ACTOR_THREAD_CACHE 256
+#endif
+
+#ifndef ACTOR_THREAD_CACHE_IDLE
+#define ACTOR_THREAD_CACHE_IDLE 10
+#endif
+
+typedef void *(*threads_func_ptr_t)(void *);
+
+/*
+  Runs func(arg) on a parked or new thread. A stack_size of 0 takes the
+  default; a guard_size of -1 takes the default guard, 0 leaves it out.
+  Returns 0, or an error number from pthread_create().
+*/
+int threads_run(
+    threads_func_ptr_t func,
+    void *arg,
+    size_t stack_size,
+    long guard_size);
+
+/* threads parked right now */
+int threads_parked();
+
+/* lets the parked threads exit and waits for them */
+void threads_stop();
+
+#endif  // SRC_THREADS_H_
@@ -0,0 +1,164 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#define _GNU_SOURCE  /* for cpu_set_t */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./topology.h"
+
+/* from <numaif.h>, which comes with libnuma */
+#define TOPOLOGY_MPOL_DEFAULT 0
+#define TOPOLOGY_MPOL_PREFERRED 1
+
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static int topology_node_count = 1;
+static cpu_set_t topology_cpus[TOPOLOGY_MAX_NODES];
+static cpu_set_t topology_process_cpus;
+/* topology_cpus[] cut down to topology_process_cpus; empty when offline */
+static cpu_set_t topology_usable_cpus[TOPOLOGY_MAX_NODES];
+
+
+/* parses a sysfs list such as "0-3,8-11" into `set` */
+static int topology_read_list(const char *path, cpu_set_t *set) {
+  FILE *f = fopen(path, "r");
+  int first, last, n;
+  char sep;
+
+  CPU_ZERO(set);
+  if (f == NULL) return -1;
+  while ((n = fscanf(f, "%d", &first)) == 1) {
+    last = first;
+    sep = (char)fgetc(f);
+    if (sep == '-') {
+      if (fscanf(f, "%d", &last) != 1) break;
+      sep = (char)fgetc(f);
+    }
+    for (; first <= last && first < CPU_SETSIZE; first++) CPU_SET(first, set);
+    if (sep != ',') break;
+  }
+  fclose(f);
+  return 0;
+}
+
+static void topology_init() {
+  char path[64];
+  cpu_set_t online;
+  int node;
+  long cpu;
+
+  sched_getaffinity(0, sizeof(cpu_set_t), &topology_process_cpus);
+
+  if (topology_read_list("/sys/devices/system/node/online", &online) == 0) {
+    for (node = 0; node < TOPOLOGY_MAX_NODES; node++) {
+      if (!CPU_ISSET(node, &online)) continue;
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/node/node%d/cpulist", node);
+      topology_read_list(path, &topology_cpus[node]);
+      topology_node_count = node + 1;
+    }
+  }
+
+  if (CPU_COUNT(&topology_cpus[0]) == 0 && topology_node_count == 1) {
+    for (cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); cpu++) {
+      CPU_SET(cpu, &topology_cpus[0]);
+    }
+  }
+
+  for (node = 0; node < topology_node_count; node++) {
+    CPU_AND(&topology_usable_cpus[node],
+            &topology_cpus[node], &topology_process_cpus);
+  }
+}
+
+int topology_nodes() {
+  pthread_once(&topology_once, topology_init);
+  return topology_node_count;
+}
+
+int topology_cpu_node(int cpu) {
+  int node;
+
+  pthread_once(&topology_once, topology_init);
+  if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+  for (node = 0; node < topology_node_count; node++) {
+    if (CPU_ISSET(cpu, &topology_cpus[node])) return node;
+  }
+  return -1;
+}
+
+int topology_cpu_usable(int cpu) {
+  pthread_once(&topology_once, topology_init);
+  return cpu >= 0 && cpu < CPU_SETSIZE &&
+      CPU_ISSET(cpu, &topology_process_cpus);
+}
+
+int topology_node_usable(int node) {
+  pthread_once(&topology_once, topology_init);
+  return node >= 0 && node < topology_node_count &&
+      CPU_COUNT(&topology_usable_cpus[node]) > 0;
+}
+
+int topology_current_node() {
+  unsigned cpu, node;
+
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return 0;
+  return (int)node;
+}
+
+int topology_place(int cpu, int node) {
+  unsigned long mask[TOPOLOGY_MAX_NODES / (8 * sizeof(unsigned long))];
+  cpu_set_t set;
+  int ret;
+
+  pthread_once(&topology_once, topology_init);
+  if (cpu >= CPU_SETSIZE || node >= topology_node_count) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (cpu >= 0) {
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    node = topology_cpu_node(cpu);
+  } else if (node >= 0) {
+    memcpy(&set, &topology_usable_cpus[node], sizeof(cpu_set_t));
+  } else {
+    memcpy(&set, &topology_process_cpus, sizeof(cpu_set_t));
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &set) != 0) return -1;
+
+  /* kernels without NUMA support refuse this, which changes nothing */
+  if (node < 0) {
+    ret = syscall(SYS_set_mempolicy, TOPOLOGY_MPOL_DEFAULT, NULL, 0);
+  } else {
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    ret = syscall(SYS_set_mempolicy, TOPOLOGY_MPOL_PREFERRED,
+                  mask, TOPOLOGY_MAX_NODES + 1);
+  }
+  if (ret != 0 && errno != ENOSYS && errno != EPERM) return -1;
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_TOPOLOGY_H_
+#define SRC_TOPOLOGY_H_
+
+/*
+  CPU and NUMA node layout, read once from /sys/devices/system/node, and
+  thread placement through the raw sched_setaffinity(), getcpu() and
+  set_mempolicy() system calls, so that libnuma is not needed. Without
+  the sysfs files every CPU is taken to be on node 0.
+*/
+
+#define TOPOLOGY_MAX_NODES 64
+
+/*
+  One more than the highest online node id, at least 1. Ids below it may
+  belong to offline nodes.
+*/
+int topology_nodes();
+
+/* the node of `cpu`, or -1 */
+int topology_cpu_node(int cpu);
+
+/* whether the process may run on `cpu` */
+int topology_cpu_usable(int cpu);
+
+/* whether `node` is online and has CPUs the process may run on */
+int topology_node_usable(int node);
+
+/* the node the calling thread is running on right now */
+int topology_current_node();
+
+/*
+  Pins the calling thread to `cpu`, or if that is -1 to the CPUs of
+  `node` that the process may run on, and has the kernel take its new pages from that node, falling
+  back to other nodes when it runs out. With both -1 the thread gets back
+  the CPUs the process started with and the default policy. Returns 0, or
+  -1 with errno set.
+*/
+int topology_place(int cpu, int node);
+
+#endif  // SRC_TOPOLOGY_H_
@@ -0,0 +1,361 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./trace.h"
+
+#if defined(_MSC_VER)
+#  define TRACE_TLS __declspec(thread)
+#else
+#  define TRACE_TLS __thread
+#endif  // defined(_MSC_VER)
+
+/* one per thread that has ever recorded at once; never freed */
+struct trace_ring {
+  struct trace_ring *next;
+  int in_use;
+  unsigned long head;  /* events ever recorded; written by the owner only */
+  struct trace_event events[TRACE_RING_EVENTS];
+};
+
+int trace_enabled = 0;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static struct trace_ring *trace_rings = NULL;
+
+static TRACE_TLS struct trace_ring *trace_self = NULL;
+
+/* the thread that dumps on a signal, see trace_dump_on_signal() */
+static pthread_mutex_t trace_signal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sem_t trace_signal_sem;
+static pthread_t trace_signal_thread;
+static int trace_signal_running = 0;
+static int trace_signal_stopping = 0;
+static int trace_signal_no;
+static char *trace_signal_path = NULL;
+static struct sigaction trace_signal_old;
+
+
+static void trace_thread_exit(void *arg) {
+  struct trace_ring *r = (struct trace_ring*)arg;
+  __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_key_init() {
+  pthread_key_create(&trace_key, trace_thread_exit);
+}
+
+static struct trace_ring *trace_register() {
+  struct trace_ring *r;
+
+  pthread_once(&trace_once, trace_key_init);
+  pthread_mutex_lock(&trace_mutex);
+
+  for (r = trace_rings; r != NULL; r = r->next) {
+    if (__atomic_load_n(&r->in_use, __ATOMIC_ACQUIRE) == 0) break;
+  }
+  if (r == NULL) {
+    r = (struct trace_ring*)calloc(1, sizeof(struct trace_ring));
+    if (r == NULL) {
+      pthread_mutex_unlock(&trace_mutex);
+      return NULL;
+    }
+    r->next = trace_rings;
+    __atomic_store_n(&trace_rings, r, __ATOMIC_RELEASE);
+  }
+  r->in_use = 1;
+
+  pthread_mutex_unlock(&trace_mutex);
+
+  pthread_setspecific(trace_key, r);
+  trace_self = r;
+  return r;
+}
+
+void trace_record(
+    int kind,
+    long actor,
+    long peer,
+    long type,
+    unsigned long size,
+    unsigned long depth,
+    unsigned long id) {
+
+  struct trace_ring *r = trace_self;
+  struct trace_event *e;
+  struct timespec ts;
+  unsigned long head;
+
+  if (r == NULL && (r = trace_register()) == NULL) return;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  head = r->head;
+  e = &r->events[head & (TRACE_RING_EVENTS - 1)];
+
+  /* a reader that sees any of these stores also sees the head that
+     marks the slot as being rewritten; see trace_copy() */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(
+      &e->ts,
+      (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+      __ATOMIC_RELAXED);
+  __atomic_store_n(&e->actor, actor, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->peer, peer, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->type, type, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->size, size, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->depth, depth, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->id, id, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->kind, kind, __ATOMIC_RELAXED);
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_enabled(int enabled) {
+  __atomic_store_n(&trace_enabled, enabled != 0, __ATOMIC_RELAXED);
+}
+
+/*
+  Copies the events still in `r` into `out`, oldest first, and returns
+  how many. The owner keeps recording meanwhile, so the copy is checked
+  against the head afterwards: a slot whose next event may have started
+  to be written by then is dropped rather than reported torn.
+*/
+static unsigned long trace_copy(struct trace_ring *r, struct trace_event *out) {
+  struct trace_event *e;
+  unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  unsigned long first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+  unsigned long count = 0;
+  unsigned long i;
+
+  for (i = first; i < head; i++) {
+    e = &r->events[i & (TRACE_RING_EVENTS - 1)];
+    out[count].ts = __atomic_load_n(&e->ts, __ATOMIC_RELAXED);
+    out[count].actor = __atomic_load_n(&e->actor, __ATOMIC_RELAXED);
+    out[count].peer = __atomic_load_n(&e->peer, __ATOMIC_RELAXED);
+    out[count].type = __atomic_load_n(&e->type, __ATOMIC_RELAXED);
+    out[count].size = __atomic_load_n(&e->size, __ATOMIC_RELAXED);
+    out[count].depth = __atomic_load_n(&e->depth, __ATOMIC_RELAXED);
+    out[count].id = __atomic_load_n(&e->id, __ATOMIC_RELAXED);
+    out[count].kind = __atomic_load_n(&e->kind, __ATOMIC_RELAXED);
+    count++;
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  /* event i's slot is reused by event i + TRACE_RING_EVENTS */
+  if (first + TRACE_RING_EVENTS <= head) {
+    i = head - TRACE_RING_EVENTS + 1 - first;
+    if (i > count) i = count;
+    memmove(out, out + i, sizeof(struct trace_event) * (count - i));
+    count -= i;
+  }
+  return count;
+}
+
+/* one event as Chrome trace event JSON objects, preceded by `sep` */
+static void trace_write(FILE *out, const char *sep, struct trace_event *e) {
+  int pid = (int)getpid();
+  double us = e->ts / 1000.0;
+
+  switch (e->kind) {
+    case TRACE_SPAWN:
+      fprintf(out,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%ld,\"args\":{\"name\":\"actor %ld\"}},\n",
+              sep, pid, e->actor, e->actor);
+      fprintf(out,
+              "{\"name\":\"spawn\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f,\"args\":{\"parent\":%ld}}",
+              pid, e->actor, us, e->peer);
+      break;
+    case TRACE_EXIT:
+      fprintf(out,
+              "%s{\"name\":\"exit\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f}",
+              sep, pid, e->actor, us);
+      break;
+    case TRACE_SEND:
+      fprintf(out,
+              "%s{\"name\":\"send\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f,\"args\":{\"to\":%ld,\"type\":%ld,"
+              "\"size\":%lu}},\n",
+              sep, pid, e->actor, us, e->peer, e->type, e->size);
+      fprintf(out,
+              "{\"name\":\"message\",\"cat\":\"message\",\"ph\":\"s\","
+              "\"id\":\"0x%lx\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f}",
+              e->id, pid, e->actor, us);
+      break;
+    case TRACE_ENQUEUE:
+      fprintf(out,
+              "%s{\"name\":\"mailbox %ld\",\"ph\":\"C\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f,\"args\":{\"depth\":%lu}}",
+              sep, e->actor, pid, e->actor, us, e->depth);
+      break;
+    case TRACE_DEQUEUE:
+      fprintf(out,
+              "%s{\"name\":\"mailbox %ld\",\"ph\":\"C\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f,\"args\":{\"depth\":%lu}},\n",
+              sep, e->actor, pid, e->actor, us, e->depth);
+      fprintf(out,
+              "{\"name\":\"receive\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f,\"args\":{\"from\":%ld,\"type\":%ld,"
+              "\"size\":%lu}},\n",
+              pid, e->actor, us, e->peer, e->type, e->size);
+      fprintf(out,
+              "{\"name\":\"message\",\"cat\":\"message\",\"ph\":\"f\","
+              "\"bp\":\"e\",\"id\":\"0x%lx\",\"pid\":%d,\"tid\":%ld,"
+              "\"ts\":%.3f}",
+              e->id, pid, e->actor, us);
+      break;
+    case TRACE_BLOCK:
+    case TRACE_UNBLOCK:
+      fprintf(out,
+              "%s{\"name\":\"blocked\",\"ph\":\"%s\",\"pid\":%d,"
+              "\"tid\":%ld,\"ts\":%.3f}",
+              sep, e->kind == TRACE_BLOCK ? "B" : "E", pid, e->actor, us);
+      break;
+  }
+}
+
+int trace_dump(const char *path) {
+  struct trace_ring *r;
+  struct trace_event *events;
+  unsigned long count, i;
+  const char *sep = "";
+  FILE *out;
+
+  events = (struct trace_event*)malloc(
+      sizeof(struct trace_event) * TRACE_RING_EVENTS);
+  if (events == NULL) return -1;
+  if ((out = fopen(path, "w")) == NULL) {
+    free(events);
+    return -1;
+  }
+
+  fprintf(out, "{\"traceEvents\":[\n");
+  for (r = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+       r != NULL;
+       r = r->next) {
+    count = trace_copy(r, events);
+    for (i = 0; i < count; i++) {
+      trace_write(out, sep, &events[i]);
+      sep = ",\n";
+    }
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  free(events);
+  if (fclose(out) != 0) return -1;
+  return 0;
+}
+
+static void trace_signal_handler(int signo) {
+  sem_post(&trace_signal_sem);  /* async-signal-safe, unlike the dump */
+}
+
+static void *trace_signal_main(void *arg) {
+  for (;;) {
+    while (sem_wait(&trace_signal_sem) != 0 && errno == EINTR) {}
+    if (__atomic_load_n(&trace_signal_stopping, __ATOMIC_ACQUIRE)) break;
+
+    pthread_mutex_lock(&trace_signal_mutex);
+    if (trace_dump(trace_signal_path) != 0) {
+      fprintf(stderr, "libactor: could not write trace to %s: %s\n",
+              trace_signal_path, strerror(errno));
+    }
+    pthread_mutex_unlock(&trace_signal_mutex);
+  }
+  return NULL;
+}
+
+int trace_dump_on_signal(int signo, const char *path) {
+  struct sigaction sa;
+  char *copy = strdup(path);
+
+  if (copy == NULL) return -1;
+
+  pthread_mutex_lock(&trace_signal_mutex);
+
+  if (trace_signal_running) {
+    /* only the path changes; the handler stays on the first signal */
+    free(trace_signal_path);
+    trace_signal_path = copy;
+    pthread_mutex_unlock(&trace_signal_mutex);
+    return 0;
+  }
+
+  sem_init(&trace_signal_sem, 0, 0);
+  trace_signal_stopping = 0;
+  if (pthread_create(
+          &trace_signal_thread, NULL, trace_signal_main, NULL) != 0) {
+    sem_destroy(&trace_signal_sem);
+    pthread_mutex_unlock(&trace_signal_mutex);
+    free(copy);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = trace_signal_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(signo, &sa, &trace_signal_old);
+
+  trace_signal_no = signo;
+  trace_signal_path = copy;
+  trace_signal_running = 1;
+
+  pthread_mutex_unlock(&trace_signal_mutex);
+  return 0;
+}
+
+void trace_stop() {
+  int running;
+
+  trace_set_enabled(0);
+
+  pthread_mutex_lock(&trace_signal_mutex);
+  running = trace_signal_running;
+  if (running) sigaction(trace_signal_no, &trace_signal_old, NULL);
+  pthread_mutex_unlock(&trace_signal_mutex);
+  if (!running) return;
+
+  __atomic_store_n(&trace_signal_stopping, 1, __ATOMIC_RELEASE);
+  sem_post(&trace_signal_sem);
+  pthread_join(trace_signal_thread, NULL);
+  sem_destroy(&trace_signal_sem);
+
+  pthread_mutex_lock(&trace_signal_mutex);
+  free(trace_signal_path);
+  trace_signal_path = NULL;
+  trace_signal_running = 0;
+  pthread_mutex_unlock(&trace_signal_mutex);
+}
@@ -0,0 +1,94 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+/*
+  Event tracing into per-thread rings. Each thread that records an event
+  claims a ring of TRACE_RING_EVENTS events, which it alone writes, so
+  recording takes no lock and no atomic read-modify-write; once a ring is
+  full the oldest events are overwritten. A thread that exits hands its
+  ring on to the next thread that records, so thread-per-actor programs
+  need no more rings than they have threads at once.
+
+  trace_dump() copies the rings while they are written and drops any
+  event that was overwritten during the copy. Events are keyed by actor,
+  not by thread, so which ring an event landed in does not matter.
+
+  TRACE() tests trace_enabled before evaluating its arguments, so a
+  tracepoint costs a single well-predicted branch while tracing is off.
+*/
+
+#define TRACE_RING_EVENTS 8192  /* a power of two */
+
+/* `id` tells messages apart, to link each send to its dequeue */
+enum {
+  TRACE_SPAWN = 1,  /* actor was spawned by peer */
+  TRACE_EXIT,
+  TRACE_SEND,       /* actor sent a message to peer */
+  TRACE_ENQUEUE,    /* a message from peer entered actor's mailbox */
+  TRACE_DEQUEUE,    /* a message from peer left actor's mailbox */
+  TRACE_BLOCK,      /* actor started waiting for a message */
+  TRACE_UNBLOCK
+};
+
+extern int trace_enabled;
+
+struct trace_event {
+  unsigned long long ts;  /* ns on CLOCK_MONOTONIC */
+  long actor;  /* the actor whose timeline the event belongs to */
+  long peer;
+  long type;  /* of the message */
+  unsigned long size;
+  unsigned long depth;  /* of the mailbox, after an enqueue or dequeue */
+  unsigned long id;
+  int kind;
+};
+
+#define TRACE(_kind, _actor, _peer, _type, _size, _depth, _id) \
+  do { \
+    if (__builtin_expect( \
+            __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED), 0)) { \
+      trace_record( \
+          (_kind), (_actor), (_peer), (_type), (_size), (_depth), (_id)); \
+    } \
+  } while (0)
+
+void trace_record(
+    int kind,
+    long actor,
+    long peer,
+    long type,
+    unsigned long size,
+    unsigned long depth,
+    unsigned long id);
+
+void trace_set_enabled(int enabled);
+
+/* writes every recorded event to `path` as Chrome trace event JSON */
+int trace_dump(const char *path);
+
+/* dumps to `path` from a background thread each time `signo` arrives */
+int trace_dump_on_signal(int signo, const char *path);
+
+/* joins the signal dump thread, if any */
+void trace_stop();
+
+#endif  // SRC_TRACE_H_
@@ -0,0 +1,311 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./slab.h"
+#include "./slotmap.h"
+#include "./wheel.h"
+
+struct wheel_timer {
+  struct wheel_timer *next;  /* in its slot, or in a list of fired timers */
+  struct wheel_timer **pprev;
+  unsigned long expires;
+  long handle;
+  int level;
+  wheel_func_ptr_t func;
+  void *arg;
+};
+
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wheel_cond;  /* on CLOCK_MONOTONIC, see wheel_start() */
+static pthread_t wheel_thread;
+static int wheel_running = 0;
+static int wheel_stopping = 0;
+
+/* the slots of every tick up to this one have been run */
+static unsigned long wheel_tick;
+
+/* when the sleeping thread looks at the wheel again; 0 while it is awake */
+static unsigned long wheel_wake_at;
+
+static struct wheel_timer *wheel_slots[WHEEL_LEVELS][WHEEL_SLOTS];
+static long wheel_counts[WHEEL_LEVELS];
+static slotmap_t wheel_registry;
+
+
+unsigned long wheel_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+  The first tick at least `delay` ms away. wheel_now() truncates, so part
+  of the current tick has already gone and one more is added to make sure
+  a timer never fires early.
+*/
+unsigned long wheel_deadline(long delay) {
+  return wheel_now() + (delay > 0 ? delay : 0) + 1;
+}
+
+/*
+  The lowest level whose current block, relative to wheel_tick, holds
+  `expires`. Within that block its slot comes after the current one.
+*/
+static int wheel_level(unsigned long expires) {
+  int level;
+  int shift;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+    shift = WHEEL_SLOT_BITS * (level + 1);
+    if ((expires >> shift) == (wheel_tick >> shift)) break;
+  }
+  return level;
+}
+
+static void wheel_place(struct wheel_timer *t) {
+  int level = wheel_level(t->expires);
+  struct wheel_timer **slot = &wheel_slots[level][
+      (t->expires >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1)];
+
+  t->level = level;
+  t->next = *slot;
+  if (t->next != NULL) t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+  wheel_counts[level]++;
+}
+
+static void wheel_unlink(struct wheel_timer *t) {
+  *t->pprev = t->next;
+  if (t->next != NULL) t->next->pprev = t->pprev;
+  wheel_counts[t->level]--;
+}
+
+/*
+  The first tick after wheel_tick at which a slot holding timers is due,
+  or ULONG_MAX if there are none. Timers of a level all come before those
+  of the levels above it, so only the lowest non-empty level is searched.
+*/
+static unsigned long wheel_next() {
+  unsigned long base;
+  int level, slot, shift;
+
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    if (wheel_counts[level] == 0) continue;
+
+    shift = WHEEL_SLOT_BITS * level;
+    slot = (int)((wheel_tick >> shift) & (WHEEL_SLOTS - 1)) + 1;
+    for (; slot < WHEEL_SLOTS; slot++) {
+      if (wheel_slots[level][slot] == NULL) continue;
+      base = (wheel_tick >> (shift + WHEEL_SLOT_BITS))
+          << (shift + WHEEL_SLOT_BITS);
+      return base + ((unsigned long)slot << shift);
+    }
+  }
+  return ULONG_MAX;
+}
+
+/*
+  Runs the wheel up to `now`, jumping straight between the ticks that
+  have work. Slots reached on higher levels are spread over the levels
+  below, highest first; timers due are unregistered and put on *fired.
+*/
+static void wheel_advance(unsigned long now, struct wheel_timer **fired) {
+  struct wheel_timer **slot;
+  struct wheel_timer *t;
+  unsigned long next;
+  int level, shift;
+
+  while ((next = wheel_next()) <= now) {
+    wheel_tick = next;
+
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+      shift = WHEEL_SLOT_BITS * level;
+      if ((next & ((1UL << shift) - 1)) != 0) continue;
+      slot = &wheel_slots[level][(next >> shift) & (WHEEL_SLOTS - 1)];
+      while ((t = *slot) != NULL) {
+        wheel_unlink(t);
+        wheel_place(t);
+      }
+    }
+
+    slot = &wheel_slots[0][next & (WHEEL_SLOTS - 1)];
+    while ((t = *slot) != NULL) {
+      wheel_unlink(t);
+      slotmap_remove(&wheel_registry, t->handle);
+      t->next = *fired;
+      *fired = t;
+    }
+  }
+  if (now > wheel_tick) wheel_tick = now;
+}
+
+/* calls and frees a list of timers taken off the wheel */
+static void wheel_run(struct wheel_timer *t, int fired) {
+  struct wheel_timer *next;
+  int sclass = slab_class(sizeof(struct wheel_timer));
+
+  for (; t != NULL; t = next) {
+    next = t->next;
+    t->func(t->arg, fired);
+    slab_free(t, sclass);
+  }
+}
+
+static void *wheel_main(void *arg) {
+  struct wheel_timer *fired;
+  struct timespec ts;
+
+  pthread_mutex_lock(&wheel_mutex);
+  while (!wheel_stopping) {
+    fired = NULL;
+    wheel_advance(wheel_now(), &fired);
+    if (fired != NULL) {
+      pthread_mutex_unlock(&wheel_mutex);
+      wheel_run(fired, 1);
+      pthread_mutex_lock(&wheel_mutex);
+      continue;
+    }
+
+    wheel_wake_at = wheel_next();
+    if (wheel_wake_at == ULONG_MAX) {
+      pthread_cond_wait(&wheel_cond, &wheel_mutex);
+    } else {
+      ts.tv_sec = wheel_wake_at / 1000;
+      ts.tv_nsec = (wheel_wake_at % 1000) * 1000000;
+      pthread_cond_timedwait(&wheel_cond, &wheel_mutex, &ts);
+    }
+    wheel_wake_at = 0;
+  }
+  pthread_mutex_unlock(&wheel_mutex);
+
+  return NULL;
+}
+
+/* called with wheel_mutex held */
+static int wheel_start() {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&wheel_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  wheel_tick = wheel_now();
+  wheel_wake_at = 0;
+  wheel_stopping = 0;
+  if (pthread_create(&wheel_thread, NULL, wheel_main, NULL) != 0) {
+    pthread_cond_destroy(&wheel_cond);
+    return -1;
+  }
+  wheel_running = 1;
+  return 0;
+}
+
+long wheel_arm(unsigned long expires, wheel_func_ptr_t func, void *arg) {
+  int sclass = slab_class(sizeof(struct wheel_timer));
+  struct wheel_timer *t = (struct wheel_timer*)slab_alloc(sclass);
+  long handle;
+
+  assert(t != NULL);
+  t->func = func;
+  t->arg = arg;
+
+  pthread_mutex_lock(&wheel_mutex);
+
+  if (!wheel_running && wheel_start() != 0) {
+    pthread_mutex_unlock(&wheel_mutex);
+    slab_free(t, sclass);
+    return WHEEL_INVALID;
+  }
+  if ((handle = slotmap_insert(&wheel_registry, t)) == SLOTMAP_INVALID) {
+    pthread_mutex_unlock(&wheel_mutex);
+    slab_free(t, sclass);
+    return WHEEL_INVALID;
+  }
+
+  /* the current tick's slot has already been run */
+  if (expires <= wheel_tick) expires = wheel_tick + 1;
+  if (expires - wheel_tick > WHEEL_MAX_DELAY) {
+    expires = wheel_tick + WHEEL_MAX_DELAY;
+  }
+  t->handle = handle;
+  t->expires = expires;
+  wheel_place(t);
+
+  if (expires < wheel_wake_at) pthread_cond_signal(&wheel_cond);
+
+  pthread_mutex_unlock(&wheel_mutex);
+
+  return handle;
+}
+
+int wheel_cancel(long handle) {
+  struct wheel_timer *t;
+
+  pthread_mutex_lock(&wheel_mutex);
+  t = (struct wheel_timer*)slotmap_remove(&wheel_registry, handle);
+  if (t != NULL) wheel_unlink(t);
+  pthread_mutex_unlock(&wheel_mutex);
+
+  if (t == NULL) return -1;
+  t->next = NULL;
+  wheel_run(t, 0);
+  return 0;
+}
+
+void wheel_stop() {
+  struct wheel_timer *pending = NULL;
+  struct wheel_timer *t;
+  int level, slot;
+
+  pthread_mutex_lock(&wheel_mutex);
+  if (!wheel_running) {
+    pthread_mutex_unlock(&wheel_mutex);
+    return;
+  }
+  wheel_stopping = 1;
+  pthread_cond_signal(&wheel_cond);
+  pthread_mutex_unlock(&wheel_mutex);
+
+  pthread_join(wheel_thread, NULL);
+
+  pthread_mutex_lock(&wheel_mutex);
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+      while ((t = wheel_slots[level][slot]) != NULL) {
+        wheel_unlink(t);
+        t->next = pending;
+        pending = t;
+      }
+    }
+  }
+  slotmap_destroy(&wheel_registry);
+  pthread_cond_destroy(&wheel_cond);
+  wheel_running = 0;
+  pthread_mutex_unlock(&wheel_mutex);
+
+  wheel_run(pending, 0);
+}
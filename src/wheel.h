@@ -0,0 +1,67 @@
+/*
+  Copyright (C) 2009 Chris Moos
+
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SRC_WHEEL_H_
+#define SRC_WHEEL_H_
+
+/*
+  Hierarchical timer wheel on CLOCK_MONOTONIC with millisecond ticks.
+
+  WHEEL_LEVELS levels of WHEEL_SLOTS slots each; a slot of level L spans
+  WHEEL_SLOTS^L ticks. A timer sits in the lowest level whose slots are
+  fine enough to tell its expiry apart from the current tick, and moves
+  down a level each time the wheel reaches its slot, so arming and
+  cancelling are O(1) and each timer is touched at most once per level.
+
+  A background thread, started by the first wheel_arm(), sleeps until the
+  next slot that holds timers and runs expired timers' functions outside
+  the wheel lock. Timers are looked up by generational handles, so a
+  stale handle fails to cancel instead of hitting a recycled timer.
+*/
+
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_LEVELS 7
+
+/* longer delays are cut to this many ticks (about 49 days) */
+#define WHEEL_MAX_DELAY 0xffffffffUL
+
+#define WHEEL_INVALID -1
+
+/*
+  Called once per timer: with `fired` set when it expires, or with
+  `fired` 0 when it is cancelled or the wheel is stopped, so that it can
+  free `arg` either way.
+*/
+typedef void (*wheel_func_ptr_t)(void *arg, int fired);
+
+/* milliseconds on CLOCK_MONOTONIC; the wheel's time base */
+unsigned long wheel_now();
+unsigned long wheel_deadline(long delay);
+
+/* calls func(arg, 1) once wheel_now() >= expires; returns a handle */
+long wheel_arm(unsigned long expires, wheel_func_ptr_t func, void *arg);
+
+/* 0 if the timer was cancelled, -1 if it already fired or is firing */
+int wheel_cancel(long handle);
+
+/* joins the thread and cancels every pending timer */
+void wheel_stop();
+
+#endif  // SRC_WHEEL_H_